@@ -0,0 +1,37 @@
+/* Many calls of small functions with several arguments. */
+
+int max(int a, int b)
+{
+  if (a > b) {
+    return a;
+  }
+  return b;
+}
+
+int clamp(int x, int lo, int hi)
+{
+  return max(lo, hi - max(hi - x, 0));
+}
+
+int mix(int a, int b, int c, int d)
+{
+  int t;
+
+  t = a * 31 + b;
+  t = t * 31 + c;
+  return t % 1000 + d;
+}
+
+int main()
+{
+  int i, sum;
+
+  sum = 0;
+  for (i = 0; i < 40000; i = i + 1) {
+    sum = sum + clamp(i % 200, 10, 150);
+    sum = sum + mix(i, i + 1, i + 2, 3) % 7;
+  }
+  print(sum);
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+/* Recursion: Fibonacci numbers and factorials. */
+
+int fib(int n)
+{
+  if (n < 2) {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+
+int factr(int i)
+{
+  if (i < 2) {
+    return 1;
+  }
+  return i * factr(i - 1);
+}
+
+int main()
+{
+  int i, sum;
+
+  print(fib(24));
+
+  sum = 0;
+  for (i = 0; i < 2000; i = i + 1) {
+    sum = sum + factr(12) / 479001600;
+  }
+  print(sum);
+
+  return 0;
+}
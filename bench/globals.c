@@ -0,0 +1,31 @@
+/* Work done on global variables. */
+
+int a, b, c, total, steps;
+char flag;
+
+int step()
+{
+  a = a + 3;
+  b = b + a % 7;
+  c = (a + b) % 1000;
+  if (c > 500) {
+    flag = 1;
+  }
+  else {
+    flag = 0;
+  }
+  total = total + flag;
+  steps = steps + 1;
+  return 0;
+}
+
+int main()
+{
+  while (steps < 60000) {
+    step();
+  }
+  print(total);
+  print(b);
+
+  return 0;
+}
@@ -0,0 +1,264 @@
+/* Benchmark harness for the Little C interpreter.
+
+	lcbench [-n RUNS] [-g FUNCTIONS] [-o OPTION]... LITTLEC PROGRAM...
+
+   Each program is run RUNS times (5 by default) by the
+   interpreter LITTLEC, given each OPTION, with no input and its
+   output thrown away. The results are written to the standard
+   output as JSON: the median wall time of the runs, the
+   statements run per second, and the peak resident set size.
+   The statements are counted by one more run with the same
+   options and --stats. Only the token walking interpreter
+   counts them, so with --engine=vm or --jit they are null.
+   With -g, a program of
+   FUNCTIONS generated functions is run as well, named
+   "startup", to time loading a very large source.
+
+   This needs POSIX, to start the interpreter and measure it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_OPTS 32
+
+struct result {
+	double ms;      /* wall time */
+	long rss;       /* peak resident set size in kilobytes */
+	int status;     /* exit status, or -1 if it did not exit */
+	long statements; /* statements reported with --stats, or -1 */
+};
+
+char *littlec;            /* the interpreter */
+char *opts[MAX_OPTS];     /* options it is given */
+int nopts;
+
+int run(char *prog, int count, struct result *r);
+int text_engine(void);
+int bench(char *name, char *prog, int runs, int first);
+char *generate(int funcs);
+void json_string(char *s);
+int by_time(const void *a, const void *b);
+
+int main(int argc, char *argv[])
+{
+	int i, runs, funcs, first, status;
+	char *big;
+
+	runs = 5;
+	funcs = 0;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			if ((runs = atoi(argv[++i])) <= 0) break;
+		}
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+			if ((funcs = atoi(argv[++i])) <= 0) break;
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc && nopts < MAX_OPTS)
+			opts[nopts++] = argv[++i];
+		else break;
+	}
+	if (i + 1 >= argc || argv[i][0] == '-') {
+		fprintf(stderr, "Usage: lcbench [-n RUNS] [-g FUNCTIONS] [-o OPTION]... LITTLEC PROGRAM...\n");
+		return 1;
+	}
+	littlec = argv[i++];
+
+	printf("{\n  \"interpreter\": ");
+	json_string(littlec);
+	printf(",\n  \"options\": [");
+	for (first = 0; first < nopts; first++) {
+		if (first) printf(", ");
+		json_string(opts[first]);
+	}
+	printf("],\n  \"runs\": %d,\n  \"benchmarks\": [", runs);
+
+	status = 0;
+	first = 1;
+	for (; i < argc; i++) {
+		status |= bench(NULL, argv[i], runs, first);
+		first = 0;
+	}
+	if (funcs) {
+		if ((big = generate(funcs)) == NULL) {
+			fprintf(stderr, "lcbench: cannot write the generated program\n");
+			return 1;
+		}
+		status |= bench("startup", big, runs, first);
+		remove(big);
+		free(big);
+	}
+	printf("\n  ]\n}\n");
+	return status;
+}
+
+/* Run one program, and write its results. name is the name
+   to give it, or NULL for its file name without the directory
+   and extension. Return 1 if it failed.
+*/
+int bench(char *name, char *prog, int runs, int first)
+{
+	struct result *r, count;
+	char *p, *e;
+	double median;
+	long rss;
+	int i, status;
+
+	r = (struct result *)malloc(runs * sizeof(struct result));
+	if (r == NULL) {
+		fprintf(stderr, "lcbench: out of memory\n");
+		exit(1);
+	}
+	status = 0;
+	rss = 0;
+	for (i = 0; i < runs; i++) {
+		if (!run(prog, 0, &r[i]) || r[i].status != 0) status = 1;
+		if (r[i].rss > rss) rss = r[i].rss;
+	}
+	qsort(r, runs, sizeof(struct result), by_time);
+	median = runs % 2 ? r[runs / 2].ms : (r[runs / 2 - 1].ms + r[runs / 2].ms) / 2;
+	if (!text_engine() || !run(prog, 1, &count)) count.statements = -1;
+
+	printf(first ? "\n    {" : ",\n    {");
+	printf("\"name\": ");
+	if (name) json_string(name);
+	else {
+		p = strrchr(prog, '/');
+		p = p ? p + 1 : prog;
+		e = strrchr(p, '.');
+		printf("\"%.*s\"", (int)(e ? e - p : (long)strlen(p)), p);
+	}
+	printf(", \"file\": ");
+	json_string(prog);
+	printf(", \"median_ms\": %.3f, \"min_ms\": %.3f, \"max_ms\": %.3f,",
+		median, r[0].ms, r[runs - 1].ms);
+	if (count.statements < 0) printf(" \"statements\": null, \"statements_per_sec\": null,");
+	else printf(" \"statements\": %ld, \"statements_per_sec\": %.0f,", count.statements,
+		median > 0 ? count.statements / (median / 1000) : 0);
+	printf(" \"peak_rss_kb\": %ld, \"ok\": %s}", rss, status ? "false" : "true");
+	fflush(stdout);
+	free(r);
+	return status;
+}
+
+/* Run the interpreter on prog once, and fill in r. If count
+   is 1, run it with --stats as well to count the statements.
+   Return 0 if it could not be run.
+*/
+int run(char *prog, int count, struct result *r)
+{
+	char *argv[MAX_OPTS + 5], buf[4096], *p;
+	struct timespec t0, t1;
+	struct rusage ru;
+	int fd[2], i, n, len, st;
+	pid_t pid;
+
+	n = 0;
+	argv[n++] = littlec;
+	for (i = 0; i < nopts; i++) argv[n++] = opts[i];
+	if (count) argv[n++] = "--stats";
+	argv[n++] = prog;
+	argv[n] = NULL;
+
+	if (pipe(fd) != 0) return 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if ((pid = fork()) < 0) return 0;
+	if (pid == 0) { /* no input, output thrown away, errors to the pipe */
+		close(fd[0]);
+		i = open("/dev/null", O_RDWR);
+		dup2(i, 0);
+		dup2(i, 1);
+		dup2(fd[1], 2);
+		execv(littlec, argv);
+		_exit(127);
+	}
+	close(fd[1]);
+	len = 0; /* keep the end of what it reports */
+	while ((n = (int)read(fd[0], buf + len, sizeof(buf) - 1 - len)) > 0) {
+		len += n;
+		if (len == sizeof(buf) - 1) {
+			memmove(buf, buf + len / 2, len - len / 2);
+			len -= len / 2;
+		}
+	}
+	buf[len] = '\0';
+	close(fd[0]);
+	if (wait4(pid, &st, 0, &ru) < 0) return 0;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	r->ms = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+	r->rss = ru.ru_maxrss;
+	r->status = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+	r->statements = -1;
+	if ((p = strstr(buf, "run: ")) != NULL && p[5] >= '0' && p[5] <= '9' && strstr(p, "statements"))
+		r->statements = atol(p + 5);
+	return WIFEXITED(st) && WEXITSTATUS(st) != 127;
+}
+
+/* Return 1 if the options leave the program to the token
+   walking interpreter, the only one that counts statements.
+*/
+int text_engine(void)
+{
+	int i, text;
+
+	text = 1;
+	for (i = 0; i < nopts; i++) {
+		if (!strcmp(opts[i], "--engine=text")) text = 1;
+		else if (!strcmp(opts[i], "--engine=vm") || !strcmp(opts[i], "--jit")) text = 0;
+		else if (!strncmp(opts[i], "--profile=", 10)) return 1; /* which is always taken by it */
+	}
+	return text;
+}
+
+/* Write a program of funcs functions to a temporary file, and
+   return its name, which the caller must free; or NULL.
+*/
+char *generate(int funcs)
+{
+	char *name;
+	FILE *fp;
+	int fd, i;
+
+	if ((name = (char *)malloc(32)) == NULL) return NULL;
+	strcpy(name, "/tmp/lcbenchXXXXXX");
+	if ((fd = mkstemp(name)) < 0 || (fp = fdopen(fd, "w")) == NULL) {
+		free(name);
+		return NULL;
+	}
+	fprintf(fp, "/* %d generated functions */\n", funcs);
+	for (i = 0; i < funcs; i++)
+		fprintf(fp, "int f%d(int x)\n{\n  int y;\n\n  y = x * %d + 1;\n"
+			"  if (y > 100) {\n    y = y - 100;\n  }\n  return y;\n}\n\n", i, i);
+	fprintf(fp, "int main()\n{\n  print(f0(3) + f%d(4));\n  return 0;\n}\n", funcs - 1);
+	fclose(fp);
+	return name;
+}
+
+/* Write s as a JSON string. */
+void json_string(char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') putchar('\\');
+		if ((unsigned char)*s < ' ') printf("\\u%04x", *s);
+		else putchar(*s);
+	}
+	putchar('"');
+}
+
+/* Order results by their time. */
+int by_time(const void *a, const void *b)
+{
+	const struct result *x = (const struct result *)a, *y = (const struct result *)b;
+
+	return x->ms < y->ms ? -1 : x->ms > y->ms;
+}
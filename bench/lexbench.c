@@ -0,0 +1,179 @@
+/* Microbenchmark of the Little C lexer.
+
+	lexbench [-n RUNS] [-s MEGABYTES] [PROGRAM]
+
+   Lexes PROGRAM, or a generated source of about MEGABYTES
+   megabytes (16 by default) that is heavy with indentation,
+   comments and long names, RUNS times (10 by default), and
+   prints the best and median speed in megabytes per second.
+   Only lex_program() is timed, so this is built against
+   liblittlec.a and the interpreter's own header. Build the
+   library with LC_NO_SIMD defined to time the scalar lexer.
+   The speeds depend on the processor and on what else it is
+   doing, so only compare builds timed on the same machine,
+   one after the other, with enough runs to trust the median.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/littlec.h"
+
+int lex(struct lc_program *pg);
+char *generate(long size);
+char *read_source(char *fname);
+double now(void);
+int by_time(const void *a, const void *b);
+
+int main(int argc, char *argv[])
+{
+	struct lc_interp interp;
+	struct lc_program *pg;
+	char *source;
+	double *t, start;
+	long size, len;
+	int i, runs, tokens;
+
+	runs = 10;
+	size = 16;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) runs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc) size = atol(argv[++i]);
+		else break;
+	}
+	if (i < argc - 1 || (i < argc && argv[i][0] == '-') || runs <= 0 || size <= 0) {
+		fprintf(stderr, "Usage: lexbench [-n RUNS] [-s MEGABYTES] [PROGRAM]\n");
+		return 1;
+	}
+	source = i < argc ? read_source(argv[i]) : generate(size << 20);
+	if (source == NULL) {
+		fprintf(stderr, "lexbench: cannot read %s\n", argv[i]);
+		return 1;
+	}
+	len = (long)strlen(source);
+
+	t = (double *)malloc(runs * sizeof(double));
+	if (t == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	init_interp(&interp);
+	lc = &interp;
+	tokens = 0;
+	for (i = 0; i < runs; i++) {
+		pg = (struct lc_program *)calloc(1, sizeof(struct lc_program));
+		if (pg == NULL || (pg->p_buf = (char *)malloc(len + LC_PAD)) == NULL) { /* padded as load_program() does */
+			printf("Allocation Failure");
+			exit(1);
+		}
+		memcpy(pg->p_buf, source, len);
+		memset(pg->p_buf + len, 0, LC_PAD);
+		pg->p_len = (int)len;
+		start = now();
+		if (!lex(pg)) return 1;
+		t[i] = now() - start;
+		tokens = pg->tok_count;
+		free_program(pg);
+	}
+	qsort(t, runs, sizeof(double), by_time);
+
+	printf("%ld bytes, %d tokens, %d runs\n", len, tokens, runs);
+	printf("best:   %8.1f MB/s, %6.2f ns/byte\n", len / t[0] / 1e6, t[0] * 1e9 / len);
+	printf("median: %8.1f MB/s, %6.2f ns/byte\n", len / t[runs / 2] / 1e6, t[runs / 2] * 1e9 / len);
+	free(t);
+	free(source);
+	free_interp(&interp);
+	return 0;
+}
+
+/* Lex the program pg. Return 0 if it has an error, which
+   has been reported.
+*/
+int lex(struct lc_program *pg)
+{
+	lc->pg = pg;
+	if (setjmp(lc->e_buf)) {
+		out_flush();
+		return 0;
+	}
+	lex_program();
+	return 1;
+}
+
+/* Return a generated program of about size bytes. */
+char *generate(long size)
+{
+	static char *names[] = { "running_total", "loop_counter", "temporary_value", "x" };
+	char *s, *p;
+	long n;
+
+	if ((s = (char *)malloc(size + 1024)) == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	p = s;
+	for (n = 0; p - s < size; n++) {
+		p += sprintf(p,
+			"/* Function number %ld.\n"
+			"   It adds up the numbers below its argument, and\n"
+			"   is only here to be lexed, never to be run.\n"
+			"*/\n"
+			"int accumulate_%ld(int %s)\n"
+			"{\n"
+			"        int %s, %s;\n"
+			"\n"
+			"        %s = 0; // start from nothing\n"
+			"        for (%s = 0; %s < %s; %s = %s + 1) {\n"
+			"\t\t%s = %s + %s * %ld;  /* the sum so far */\n"
+			"        }\n"
+			"        if (%s >= 1000) {\n"
+			"\t\tputs(\"a large sum\");\n"
+			"        }\n"
+			"        return %s;\n"
+			"}\n\n",
+			n, n, names[3], names[0], names[1], names[0], names[1], names[1], names[3],
+			names[1], names[1], names[0], names[0], names[1], n, names[0], names[0]);
+	}
+	p += sprintf(p, "int main()\n{\n  return 0;\n}\n");
+	return s;
+}
+
+/* Return the text of the file fname, or NULL. */
+char *read_source(char *fname)
+{
+	FILE *fp;
+	char *s;
+	long n;
+
+	if ((fp = fopen(fname, "rb")) == NULL) return NULL;
+	fseek(fp, 0, SEEK_END);
+	n = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if ((s = (char *)malloc(n + 1)) == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	n = (long)fread(s, 1, n, fp);
+	s[n] = '\0';
+	fclose(fp);
+	return s;
+}
+
+/* Return the time in seconds. */
+double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Order times, the fastest first. */
+int by_time(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
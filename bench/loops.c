@@ -0,0 +1,26 @@
+/* Nested counting loops over locals. */
+
+int main()
+{
+  int i, j, k, count;
+
+  count = 0;
+  for (i = 0; i < 60; i = i + 1) {
+    for (j = 0; j < 60; j = j + 1) {
+      k = 60;
+      while (k) {
+        count = count + 1;
+        k = k - 1;
+      }
+    }
+  }
+  print(count);
+
+  i = 0;
+  do {
+    i = i + 1;
+  } while (i < 100000);
+  print(i);
+
+  return 0;
+}
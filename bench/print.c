@@ -0,0 +1,21 @@
+/* Output: numbers, strings and characters. */
+
+int main()
+{
+  int i, j;
+
+  for (i = 0; i < 40000; i = i + 1) {
+    print(i);
+    print("is");
+    print(i * i);
+    puts("");
+  }
+  for (i = 0; i < 2000; i = i + 1) {
+    for (j = 0; j < 10; j = j + 1) {
+      putch('a' + j);
+    }
+    puts("");
+  }
+
+  return 0;
+}
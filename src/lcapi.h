@@ -0,0 +1,59 @@
+/* The interface for running Little C programs from another
+   program. Build liblittlec.a and link with it.
+
+   A program is compiled once by lc_compile(), and can then be
+   run any number of times by lc_run(), from any number of
+   threads at once, since running it never changes it.
+*/
+
+#ifndef LCAPI_H
+#define LCAPI_H
+
+#include <stdio.h>
+
+/* ways of running a program */
+enum engines { TEXT_ENGINE, VM_ENGINE };
+
+/* when the output buffer is written out */
+enum flushes { FLUSH_SIZE, FLUSH_LINE, FLUSH_EXIT };
+
+struct lc_program; /* a compiled program */
+
+/* Where a program reads and writes. */
+struct lc_io {
+	FILE *in;       /* input, or NULL for none */
+	FILE *out;      /* output, and any error message */
+	int out_buffer; /* bytes of output collected before it is written */
+	int flush;      /* when output is written, one of enum flushes */
+};
+
+/* How large the tables of a program can grow. */
+struct lc_limits {
+	int max_locals;  /* local variables and arguments of the calls in progress */
+	int max_calls;   /* how deeply calls can nest */
+	int max_globals; /* global variables */
+};
+
+/* Fill in the defaults, stdin and stdout and the limits
+   littlec uses. Either argument can be NULL.
+*/
+void lc_defaults(struct lc_io *io, struct lc_limits *limits);
+
+/* Compile the null terminated source of a program to be run
+   by engine. Errors are written to io->out. Return NULL if
+   the program cannot be run. io and limits can be NULL for
+   the defaults.
+*/
+struct lc_program *lc_compile(const char *source, int engine,
+	struct lc_io *io, struct lc_limits *limits);
+
+/* Run a compiled program, and return its exit status: 0, or
+   1 if it stopped with an error. io and limits can be NULL
+   for the defaults.
+*/
+int lc_run(struct lc_program *pg, struct lc_io *io, struct lc_limits *limits);
+
+/* Free a compiled program. */
+void lc_free(struct lc_program *pg);
+
+#endif
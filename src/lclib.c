@@ -10,41 +10,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-extern char *prog; /* points to current location in program */
-extern char token[80]; /* holds string representation of token */
-extern char token_type; /* contains type of token */
-extern char tok; /* holds the internal representation of token */
-
-enum tok_types {
-	DELIMITER, IDENTIFIER, NUMBER, KEYWORD,
-	TEMP, STRING, BLOCK
-};
-
-/* These are the constants used to call sntx_err() when
-   a syntax error occurs. Add more if you like.
-   NOTE: SYNTAX is a generic error message used when
-   nothing else seems appropriate.
-*/
-enum error_msg
-{
-	SYNTAX, UNBAL_PARENS, NO_EXP, EQUALS_EXPECTED,
-	NOT_VAR, PARAM_ERR, SEMI_EXPECTED,
-	UNBAL_BRACES, FUNC_UNDEF, TYPE_EXPECTED,
-	NEST_FUNC, RET_NOCALL, PAREN_EXPECTED,
-	WHILE_EXPECTED, QUOTE_EXPECTED, NOT_STRING,
-	TOO_MANY_LVARS, DIV_BY_ZERO
-};
-
-int get_token(void);
-void sntx_err(int error), eval_exp(int *result);
-void putback(void);
+#include "littlec.h"
 
 /* Get a character from console. (Use getchar() if
    your compiler does not support       _getche().) */
-int call_getche(void)
+int read_char(void)
 {
 	char ch;
+
+	out_flush(); /* show any prompt first */
+	if (lc->in == NULL) return (char)EOF; /* no input */
+	if (lc->in != stdin) return (char)getc(lc->in);
 #if defined(_QC)
 	ch = (char)getche();
 #elif defined(_MSC_VER)
@@ -52,8 +30,28 @@ int call_getche(void)
 #else
 	ch = (char)getchar();
 #endif
-	while (*prog != ')') prog++;
-	prog++;   /* advance to end of line */
+	return ch;
+}
+
+/* Read an integer from the keyboard. */
+int read_num(void)
+{
+	char s[80];
+
+	out_flush(); /* show any prompt first */
+	if (lc->in != NULL && fgets(s, sizeof(s), lc->in) != NULL) return atoi(s);
+	else return 0;
+}
+
+/* Call getche(). */
+int call_getche(void)
+{
+	int ch;
+
+	ch = read_char();
+	do { /* advance to end of line */
+		get_token();
+	} while (*lc->token != ')' && lc->tok != FINISHED);
 	return ch;
 }
 
@@ -63,7 +61,7 @@ int call_putch(void)
 	int value;
 
 	eval_exp(&value);
-	printf("%c", value);
+	out_char(value);
 	return value;
 }
 
@@ -71,16 +69,18 @@ int call_putch(void)
 int call_puts(void)
 {
 	get_token();
-	if (*token != '(') sntx_err(PAREN_EXPECTED);
+	if (*lc->token != '(') sntx_err(PAREN_EXPECTED);
 	get_token();
-	if (token_type != STRING) sntx_err(QUOTE_EXPECTED);
-	puts(token);
+	if (lc->token_type != STRING) sntx_err(QUOTE_EXPECTED);
+	out_string(lc->cur_tok->value);
+	out_char('\n');
 	get_token();
-	if (*token != ')') sntx_err(PAREN_EXPECTED);
+	if (*lc->token != ')') sntx_err(PAREN_EXPECTED);
 
-	get_token();
-	if (*token != ';') sntx_err(SEMI_EXPECTED);
-	putback();
+	if (PEEK_TEXT() != ';') { /* leave the ; to be read */
+		get_token();
+		sntx_err(SEMI_EXPECTED);
+	}
 	return 0;
 }
 
@@ -90,39 +90,124 @@ int print(void)
 	int i;
 
 	get_token();
-	if (*token != '(')  sntx_err(PAREN_EXPECTED);
+	if (*lc->token != '(')  sntx_err(PAREN_EXPECTED);
 
-	get_token();
-	if (token_type == STRING) { /* output a string */
-		printf("%s ", token);
+	if (PEEK()->token_type == STRING) { /* output a string */
+		get_token();
+		out_string(lc->cur_tok->value);
+		out_char(' ');
 	}
 	else {  /* output a number */
-		putback();
 		eval_exp(&i);
-		printf("%d ", i);
+		out_num(i);
+		out_char(' ');
 	}
 
 	get_token();
 
-	if (*token != ')') sntx_err(PAREN_EXPECTED);
+	if (*lc->token != ')') sntx_err(PAREN_EXPECTED);
 
-	get_token();
-	if (*token != ';') sntx_err(SEMI_EXPECTED);
-	putback();
+	if (PEEK_TEXT() != ';') { /* leave the ; to be read */
+		get_token();
+		sntx_err(SEMI_EXPECTED);
+	}
 	return 0;
 }
 
-/* Read an integer from the keyboard. */
+/* Call getnum(). */
 int getnum(void)
 {
-	char s[80];
+	int value;
+
+	value = read_num();
+	do { /* advance to end of line */
+		get_token();
+	} while (*lc->token != ')' && lc->tok != FINISHED);
+	return value;
+}
+
+/* Output is collected in a buffer for each interpreter, and
+   written out when it is full, at the end of a line if the
+   flush policy is FLUSH_LINE, before input is read, and when
+   the program stops. With FLUSH_EXIT the buffer grows instead
+   of being written out when it is full.
+*/
+
+static void out_room(void);
+
+/* Output a character. */
+void out_char(int c)
+{
+	if (lc->olen == lc->osize) out_room();
+	lc->obuf[lc->olen++] = (char)c;
+	if (c == '\n' && lc->flush == FLUSH_LINE) out_flush();
+}
+
+/* Output n characters of s. */
+void out_text(char *s, int n)
+{
+	int part;
+
+	while (n > 0) {
+		if (lc->olen == lc->osize) out_room();
+		part = lc->osize - lc->olen < n ? lc->osize - lc->olen : n;
+		memcpy(lc->obuf + lc->olen, s, part);
+		lc->olen += part;
+		s += part;
+		n -= part;
+		if (lc->flush == FLUSH_LINE && memchr(s - part, '\n', part)) out_flush();
+	}
+}
+
+/* Output the string constant s. */
+void out_string(int s)
+{
+	struct str_type *sp;
+
+	sp = &lc->pg->str_table[s];
+	out_text(lc->pg->t_pool + sp->text, sp->len);
+}
+
+/* Output a number in decimal. */
+void out_num(int n)
+{
+	char buf[12], *p;
+	unsigned u;
+
+	p = buf + sizeof(buf);
+	u = n < 0 ? 0u - (unsigned)n : (unsigned)n;
+	do { /* the digits, last first */
+		*--p = (char)('0' + u % 10);
+		u /= 10;
+	} while (u);
+	if (n < 0) *--p = '-';
+	out_text(p, (int)(buf + sizeof(buf) - p));
+}
+
+/* Write out everything in the output buffer. */
+void out_flush(void)
+{
+	if (lc->olen && lc->out) {
+		fwrite(lc->obuf, 1, lc->olen, lc->out);
+		fflush(lc->out);
+	}
+	lc->olen = 0;
+}
+
+/* Make room in the output buffer when it is full. */
+static void out_room(void)
+{
+	int size;
 
-	if (fgets(s, sizeof(s), stdin) != NULL) {
-		while (*prog != ')') prog++;
-		prog++;  /* advance to end of line */
-		return atoi(s);
+	if (lc->osize && lc->flush != FLUSH_EXIT) {
+		out_flush();
+		return;
 	}
-	else {
-		return 0;
+	size = lc->osize ? lc->osize * 2 : lc->out_buffer; /* first use, or FLUSH_EXIT */
+	lc->obuf = (char *)realloc(lc->obuf, size);
+	if (lc->obuf == NULL) {
+		printf("Allocation Failure");
+		exit(1);
 	}
+	lc->osize = size;
 }
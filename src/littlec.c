@@ -6,79 +6,32 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define NUM_FUNC        100
-#define NUM_GLOBAL_VARS 100
-#define NUM_LOCAL_VARS  200
-#define NUM_BLOCK       100
-#define ID_LEN          32
-#define FUNC_CALLS      31
-#define NUM_PARAMS      31
-#define PROG_SIZE       10000
-#define LOOP_NEST       31
-
-// Secure function compatibility
-#if !defined(_MSC_VER) || _MSC_VER < 1400
-#define strcpy_s(dest, count, source) strncpy( (dest), (source), (count) )
-#define fopen_s(pFile,filename,mode) (((*(pFile))=fopen((filename),(mode)))==NULL)
+#include <time.h>
+#include <limits.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define LC_THREADS /* batch jobs can run in parallel */
+#define LC_MMAP    /* cached programs are mapped into memory */
 #endif
 
-enum tok_types {
-	DELIMITER, IDENTIFIER, NUMBER, KEYWORD,
-	TEMP, STRING, BLOCK
-};
-
-/* add additional C keyword tokens here */
-enum tokens {
-	ARG, CHAR, INT, IF, ELSE, FOR, DO, WHILE,
-	SWITCH, RETURN, CONTINUE, BREAK, EOL, FINISHED, END
-};
-
-/* add additional double operators here (such as ->) */
-enum double_ops { LT = 1, LE, GT, GE, EQ, NE };
-
-/* These are the constants used to call sntx_err() when
-   a syntax error occurs. Add more if you like.
-   NOTE: SYNTAX is a generic error message used when
-   nothing else seems appropriate.
-*/
-enum error_msg
-{
-	SYNTAX, UNBAL_PARENS, NO_EXP, EQUALS_EXPECTED,
-	NOT_VAR, PARAM_ERR, SEMI_EXPECTED,
-	UNBAL_BRACES, FUNC_UNDEF, TYPE_EXPECTED,
-	NEST_FUNC, RET_NOCALL, PAREN_EXPECTED,
-	WHILE_EXPECTED, QUOTE_EXPECTED, NOT_TEMP,
-	TOO_MANY_LVARS, DIV_BY_ZERO
-};
-
-char *prog;    /* current location in source code */
-char *p_buf;   /* points to start of program buffer */
-jmp_buf e_buf; /* hold environment for longjmp() */
-
-/* An array of these structures will hold the info
-   associated with global variables.
-*/
-struct var_type {
-	char var_name[ID_LEN];
-	int v_type;
-	int value;
-}  global_vars[NUM_GLOBAL_VARS];
+#if defined(__GNUC__) && !defined(LC_SWITCH)
+#define LC_THREADED /* the stack machine dispatches with computed goto */
+#endif
 
-struct var_type local_var_stack[NUM_LOCAL_VARS];
+#if defined(__x86_64__) && defined(__linux__)
+#define LC_JIT /* --jit compiles hot functions to native code */
+#endif
 
-struct func_type {
-	char func_name[ID_LEN];
-	int ret_type;
-	char *loc;  /* location of entry point in file */
-} func_table[NUM_FUNC];
+#include "littlec.h"
 
-int call_stack[NUM_FUNC];
+LC_THREAD struct lc_interp *lc; /* the interpreter at work */
 
-struct commands { /* keyword lookup table */
-	char command[20];
-	char tok;
-} table[] = { /* Commands must be entered lowercase */
+struct commands table[] = { /* Commands must be entered lowercase */
 	{ "if", IF }, /* in this table. */
 	{ "else", ELSE },
 	{ "for", FOR },
@@ -93,72 +46,379 @@ struct commands { /* keyword lookup table */
 	{ "", END } /* mark end of table */
 };
 
-char token[80];
-char token_type, tok;
-
-int functos;  /* index to top of function call stack */
-int func_index; /* index into function table */
-int gvar_index; /* index into global variable table */
-int lvartos; /* index into local variable stack */
-
-int ret_value; /* function return value */
-int ret_occurring; /* function return is occurring */
-int break_occurring; /* loop break is occurring */
-
-void print(void), prescan(void);
-void decl_global(void), call(void), putback(void);
-void decl_local(void), local_push(struct var_type i);
-void eval_exp(int *value), sntx_err(int error);
+void prescan(void), resolve(void), describe_loop(struct token_rec *t);
+void decl_global(void);
+void decl_local(void), local_push(int value);
 void exec_if(void), find_eob(void), exec_for(void);
-void get_params(void), get_args(void);
+void get_args(void);
 void exec_while(void), func_push(int i), exec_do(void);
-void assign_var(char *var_name, int value);
-int load_program(char *p, char *fname), find_var(char *s);
+char *load_program(char *fname);
+int prepare(char *fname, const char *source);
 void interp_block(void), func_ret(void);
-int func_pop(void), is_var(char *s);
-char *find_func(char *name), get_token(void);
-
+int func_pop(void);
+void vm_compile(void);
+int vm_run(int f);
+void jit_start(void), jit_stop(void);
+void prof_start(void), prof_stop(void), prof_tick(int line, int count);
+void prof_enter(int f, int tail), prof_leave(void);
+int run_batch(char *jobs_name, int workers);
+void report_counts(void);
+int load_cache(void);
+void store_cache(void), free_cache(struct lc_program *pg);
+
+#ifndef LC_LIBRARY /* the library has no main() */
 int main(int argc, char *argv[])
 {
-	if (argc != 2) {
-		printf("Usage: littlec <filename>\n");
+	struct lc_interp interp;
+	struct lc_program *pg;
+	char *fname, *batch;
+	int i, status, workers;
+
+	init_interp(&interp);
+	lc = &interp;
+
+	fname = batch = NULL;
+	workers = 1;
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--engine=text")) lc->engine = TEXT_ENGINE;
+		else if (!strcmp(argv[i], "--engine=vm")) lc->engine = VM_ENGINE;
+		else if (!strcmp(argv[i], "--jit")) {
+			lc->engine = VM_ENGINE;
+			lc->jit = 1;
+		}
+		else if (!strcmp(argv[i], "--stats")) lc->stats = 1;
+		else if (!strcmp(argv[i], "-O0")) lc->opt = 0;
+		else if (!strcmp(argv[i], "-O1")) lc->opt = 1;
+		else if (!strncmp(argv[i], "--output-buffer=", 16)) {
+			if ((lc->out_buffer = atoi(argv[i] + 16)) <= 0) break;
+		}
+		else if (!strcmp(argv[i], "--flush=size")) lc->flush = FLUSH_SIZE;
+		else if (!strcmp(argv[i], "--flush=line")) lc->flush = FLUSH_LINE;
+		else if (!strcmp(argv[i], "--flush=exit")) lc->flush = FLUSH_EXIT;
+		else if (!strncmp(argv[i], "--max-locals=", 13)) {
+			if ((lc->max_locals = atoi(argv[i] + 13)) <= 0) break;
+		}
+		else if (!strncmp(argv[i], "--max-calls=", 12)) {
+			if ((lc->max_calls = atoi(argv[i] + 12)) <= 0) break;
+		}
+		else if (!strncmp(argv[i], "--max-globals=", 14)) {
+			if ((lc->max_globals = atoi(argv[i] + 14)) <= 0) break;
+		}
+		else if (!strncmp(argv[i], "--cache-dir=", 12) && argv[i][12]) lc->cache_dir = argv[i] + 12;
+		else if (!strncmp(argv[i], "--profile=", 10) && argv[i][10]) lc->profile = argv[i] + 10;
+		else if (!strcmp(argv[i], "--batch") && i + 1 < argc) batch = argv[++i];
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			if ((workers = atoi(argv[++i])) <= 0) break;
+		}
+		else if (*argv[i] == '-' || fname) break;
+		else fname = argv[i];
+	}
+	if (i < argc || (fname == NULL) == (batch == NULL) || (batch && lc->profile)) {
+		printf("Usage: littlec [--engine=text|vm] [--jit] [-O0|-O1] [--stats] [--max-locals=N]\n"
+			"               [--max-calls=N] [--max-globals=N] [--output-buffer=SIZE]\n"
+			"               [--flush=size|line|exit] [--cache-dir=DIR] [--profile=FILE]\n"
+			"               <filename>\n"
+			"       littlec [options] --batch <jobs> [-j N]\n");
 		exit(1);
 	}
+	if (lc->profile) { /* the profile is taken by the token walker */
+		lc->engine = TEXT_ENGINE;
+		lc->jit = 0;
+	}
+
+	if (batch) return run_batch(batch, workers);
+
+	if ((pg = prepare_program(fname, NULL)) == NULL) exit(1);
+	status = run_program(pg);
+	free_program(pg);
+	free_interp(&interp);
+	return status;
+}
+#endif
+
+/* Set up an interpreter with the default limits. */
+void init_interp(struct lc_interp *ip)
+{
+	memset(ip, 0, sizeof(struct lc_interp));
+	ip->in = stdin;
+	ip->out = stdout;
+	ip->out_buffer = OUT_BUFFER;
+	ip->flush = FLUSH_SIZE;
+	ip->engine = TEXT_ENGINE;
+	ip->opt = 1;
+	ip->max_locals = NUM_LOCAL_VARS;
+	ip->max_calls = FUNC_CALLS;
+	ip->max_globals = NUM_GLOBAL_VARS;
+}
+
+/* Free the tables an interpreter has grown. */
+void free_interp(struct lc_interp *ip)
+{
+	free(ip->globals);
+	free(ip->local_var_stack);
+	free(ip->call_stack);
+	free(ip->vm_stack);
+	free(ip->vm_frames);
+	free(ip->obuf);
+	memset(ip, 0, sizeof(struct lc_interp));
+}
 
-	/* allocate memory for the program */
-	if ((p_buf = (char *)malloc(PROG_SIZE)) == NULL) {
+/* Load a program from the file fname, or take it from
+   source if that is not NULL, and prepare it to be run by
+   the engine the interpreter is set to use. Return NULL,
+   after reporting any error, if it cannot be run.
+*/
+struct lc_program *prepare_program(char *fname, const char *source)
+{
+	lc->pg = (struct lc_program *)calloc(1, sizeof(struct lc_program));
+	if (lc->pg == NULL) {
 		printf("Allocation Failure");
 		exit(1);
 	}
+	if (setjmp(lc->e_buf) || !prepare(fname, source)) { /* an error in the program */
+		out_flush();
+		free_program(lc->pg);
+		return NULL;
+	}
+	return lc->pg;
+}
+
+/* Do the work of prepare_program(). Return 0 if the
+   program cannot be run.
+*/
+int prepare(char *fname, const char *source)
+{
+	struct lc_program *pg;
+	clock_t start;
+
+	pg = lc->pg;
 
 	/* load the program to execute */
-	if (!load_program(p_buf, argv[1])) exit(1);
-	if (setjmp(e_buf)) exit(1); /* initialize long jump buffer */
+	start = clock();
+	if (source) { /* keep a copy of the source */
+		pg->p_len = (int)strlen(source);
+		if ((pg->p_buf = (char *)malloc(pg->p_len + LC_PAD)) == NULL) { /* the null and the padding */
+			printf("Allocation Failure");
+			exit(1);
+		}
+		memcpy(pg->p_buf, source, pg->p_len);
+		memset(pg->p_buf + pg->p_len, 0, LC_PAD);
+	}
+	else if ((pg->p_buf = load_program(fname)) == NULL) return 0;
+	if (lc->stats)
+		fprintf(stderr, "load: %d bytes in %.3f ms\n", pg->p_len,
+			(clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+
+	/* take the rest from the cache, when it has been prepared before */
+	start = clock();
+	if (lc->cache_dir && load_cache()) {
+		if (lc->stats)
+			fprintf(stderr, "cache: loaded in %.3f ms\n",
+				(clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+		return 1;
+	}
 
-	gvar_index = 0;  /* initialize global variable index */
+	lex_program(); /* convert the source into tokens */
 
-	/* set program pointer to start of program buffer */
-	prog = p_buf;
+	/* set program pointer to start of program */
+	lc->prog = pg->tok_buf;
 	prescan(); /* find the location of all functions
 				  and global variables in the program */
+	resolve(); /* bind variables to their storage */
+	if (lc->stats)
+		fprintf(stderr, "prescan: %d tokens, %d functions in %.3f ms\n", pg->tok_count,
+			pg->func_index, (clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+	if (lc->opt) { /* simplify constant expressions */
+		fold_program();
+		if (lc->stats) fprintf(stderr, "optimize: %d expressions simplified\n", lc->folds);
+	}
+
+	pg->main_func = find_func("main"); /* find program starting point */
+
+	if (pg->main_func < 0) { /* incorrect or missing main() function in program */
+		out_text("main() not found.\n", 18);
+		return 0;
+	}
 
-	lvartos = 0;     /* initialize local variable stack index */
-	functos = 0;     /* initialize the CALL stack index */
-	break_occurring = 0; /* initialize the break occurring flag */
+	if (lc->engine == VM_ENGINE) vm_compile(); /* compile every function */
+	if (lc->cache_dir) store_cache();
+	return 1;
+}
 
-	/* setup call to main() */
-	prog = find_func("main"); /* find program starting point */
+/* Run a prepared program, and return its exit status. */
+int run_program(struct lc_program *pg)
+{
+	clock_t start;
 
-	if (!prog) { /* incorrect or missing main() function in program */
-		printf("main() not found.\n");
+	lc->pg = pg;
+	lc->globals = (int *)realloc(lc->globals, (pg->gvar_index + 1) * sizeof(int));
+	if (lc->globals == NULL) {
+		printf("Allocation Failure");
 		exit(1);
 	}
+	memset(lc->globals, 0, pg->gvar_index * sizeof(int)); /* globals start at 0 */
+
+	lc->lvartos = 0;     /* initialize local variable stack index */
+	lc->functos = 0;     /* initialize the CALL stack index */
+	lc->frame = 0;
+	lc->ret_occurring = lc->break_occurring = lc->cont_occurring = 0;
+	lc->statements = 0;
+	lc->status = 0;
+	start = clock();
+	if (!setjmp(lc->e_buf)) { /* an error, or end, comes back here */
+		if (pg->vm_func) { /* run the compiled main() */
+			jit_start();
+			vm_run(pg->main_func);
+		}
+		else {
+			/* setup call to main() */
+			lc->prog = pg->func_table[pg->main_func].loc;
+			lc->prog--; /* back up to opening ( */
+			prof_start();
+			call(pg->main_func); /* call main() to start interpreting */
+		}
+	}
+	out_flush();
+	jit_stop();
+	prof_stop();
+	if (lc->stats) {
+		if (pg->vm_func) /* the stack machine does not count statements */
+			fprintf(stderr, "run: n/a statements in %.3f ms\n", (clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+		else fprintf(stderr, "run: %ld statements in %.3f ms\n", lc->statements,
+			(clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+		report_counts();
+	}
+	return lc->status;
+}
+
+/* Report the counts of the work done since they were last
+   reported, which are then cleared. Built without LC_STATS,
+   there are none.
+*/
+void report_counts(void)
+{
+#ifdef LC_STATS
+	struct lc_counts *c;
+
+	c = &lc->counts;
+	fprintf(stderr, "tokens: %ld read, %ld put back\n", c->tokens, c->putbacks);
+	fprintf(stderr, "lookups: %ld variables, %ld functions, %ld names compared\n",
+		c->var_lookups, c->func_lookups, c->compares);
+	fprintf(stderr, "calls: %ld functions, %ld library, deepest %d calls and %d locals\n",
+		c->calls, c->builtins, c->max_functos, c->max_lvartos);
+	memset(c, 0, sizeof(struct lc_counts));
+#endif
+}
+
+/* Free a program and everything prepared for it. */
+void free_program(struct lc_program *pg)
+{
+	if (pg->cache) free_cache(pg); /* the tables are in the cache file */
+	else {
+		free(pg->tok_buf);
+		free(pg->t_pool);
+		free(pg->id_text);
+		free(pg->id_tok);
+		free(pg->id_hash);
+		free(pg->str_table);
+		free(pg->sym_table);
+		free(pg->global_vars);
+		free(pg->vm_func);
+		free(pg->vm_code);
+		free(pg->vm_pos);
+	}
+	free(pg->p_buf);
+	free(pg->func_table);
+	free(pg->loop_table);
+	free(pg);
+}
 
-	prog--; /* back up to opening ( */
-	strcpy_s(token, 80, "main");
-	call(); /* call main() to start interpreting */
+/****** Embedding Interface *******/
 
-	return 0;
+/* These are the functions lcapi.h declares. Each one works
+   with an interpreter of its own, and puts back whichever one
+   the calling thread was using, so they can be called from
+   any thread, and even from within a running program.
+*/
+
+/* Fill in the defaults, stdin and stdout and the limits
+   littlec uses.
+*/
+void lc_defaults(struct lc_io *io, struct lc_limits *limits)
+{
+	struct lc_interp interp;
+
+	init_interp(&interp);
+	if (io) {
+		io->in = interp.in;
+		io->out = interp.out;
+		io->out_buffer = interp.out_buffer;
+		io->flush = interp.flush;
+	}
+	if (limits) {
+		limits->max_locals = interp.max_locals;
+		limits->max_calls = interp.max_calls;
+		limits->max_globals = interp.max_globals;
+	}
+}
+
+/* Set up an interpreter to use io and limits, when they are
+   not NULL.
+*/
+static void set_interp(struct lc_interp *ip, struct lc_io *io, struct lc_limits *limits)
+{
+	init_interp(ip);
+	if (io) {
+		ip->in = io->in;
+		ip->out = io->out;
+		ip->out_buffer = io->out_buffer > 0 ? io->out_buffer : OUT_BUFFER;
+		ip->flush = io->flush;
+	}
+	if (limits) {
+		ip->max_locals = limits->max_locals;
+		ip->max_calls = limits->max_calls;
+		ip->max_globals = limits->max_globals;
+	}
+}
+
+/* Compile the source of a program to be run by engine. */
+struct lc_program *lc_compile(const char *source, int engine,
+	struct lc_io *io, struct lc_limits *limits)
+{
+	struct lc_interp interp, *caller;
+	struct lc_program *pg;
+
+	caller = lc;
+	set_interp(&interp, io, limits);
+	interp.engine = engine;
+	lc = &interp;
+	pg = prepare_program(NULL, source);
+	free_interp(&interp);
+	lc = caller;
+	return pg;
+}
+
+/* Run a compiled program, and return its exit status. Only
+   the tables the run needs are allocated, as it grows them.
+*/
+int lc_run(struct lc_program *pg, struct lc_io *io, struct lc_limits *limits)
+{
+	struct lc_interp interp, *caller;
+	int status;
+
+	caller = lc;
+	set_interp(&interp, io, limits);
+	lc = &interp;
+	status = run_program(pg);
+	free_interp(&interp);
+	lc = caller;
+	return status;
+}
+
+/* Free a compiled program. */
+void lc_free(struct lc_program *pg)
+{
+	if (pg) free_program(pg);
 }
 
 /* Interpret a single statement or block of code. When
@@ -171,27 +431,32 @@ void interp_block(void)
 	char block = 0;
 
 	do {
-		token_type = get_token();
+		lc->token_type = get_token();
+		if (lc->token_type == IDENTIFIER || lc->token_type == KEYWORD) { /* a statement starts */
+			lc->statements++;
+			if (lc->prof) prof_tick(lc->cur_tok->line, 1);
+		}
 
 		/* If interpreting single statement, return on
 		   first semicolon.
 		*/
 
 		/* see what kind of token is up */
-		if (token_type == IDENTIFIER) {
-			/* Not a keyword, so process expression. */
-			putback();  /* restore token to input stream for
-						   further processing by eval_exp() */
-			eval_exp(&value);  /* process the expression */
-			if (*token != ';') sntx_err(SEMI_EXPECTED);
-		}
-		else if (token_type == BLOCK) { /* if block delimiter */
-			if (*token == '{') /* is a block */
+		if (lc->token_type == IDENTIFIER) {
+			/* Not a keyword, so process expression, which
+			   starts with the token just read, as eval_exp()
+			   would. */
+			eval_exp0(&value);
+			putback();
+			if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
+		}
+		else if (lc->token_type == BLOCK) { /* if block delimiter */
+			if (*lc->token == '{') /* is a block */
 				block = 1; /* interpreting block, not statement */
 			else return; /* is a }, so return */
 		}
 		else /* is keyword */
-			switch (tok) {
+			switch (lc->tok) {
 			case CHAR:
 			case INT:     /* declare local variables */
 				putback();
@@ -199,16 +464,17 @@ void interp_block(void)
 				break;
 			case RETURN:  /* return from function call */
 				func_ret();
-				ret_occurring = 1;
+				lc->ret_occurring = 1;
 				return;
 			case CONTINUE:  /* continue loop execution */
+				lc->cont_occurring = 1;
 				return;
 			case BREAK:  /* break loop execution */
-				break_occurring = 1;
+				lc->break_occurring = 1;
 				return;
 			case IF:      /* process an if statement */
 				exec_if();
-				if (ret_occurring > 0 || break_occurring > 0) {
+				if (lc->ret_occurring > 0 || lc->break_occurring > 0 || lc->cont_occurring > 0) {
 					return;
 				}
 				break;
@@ -217,344 +483,533 @@ void interp_block(void)
 				break;
 			case WHILE:   /* process a while loop */
 				exec_while();
-				if (ret_occurring > 0) {
+				if (lc->ret_occurring > 0) {
 					return;
 				}
 				break;
 			case DO:      /* process a do-while loop */
 				exec_do();
-				if (ret_occurring > 0) {
+				if (lc->ret_occurring > 0) {
 					return;
 				}
 				break;
 			case FOR:     /* process a for loop */
 				exec_for();
-				if (ret_occurring > 0) {
+				if (lc->ret_occurring > 0) {
 					return;
 				}
 				break;
 			case END:
-				exit(0);
+				stop_program(0);
 			}
-	} while (tok != FINISHED && block);
+	} while (lc->tok != FINISHED && block);
 }
 
-/* Load a program. */
-int load_program(char *p, char *fname)
+/* Load a program into a buffer allocated to fit it, ended by
+   LC_PAD zero bytes, and return the buffer, or NULL if the
+   file cannot be read.
+*/
+char *load_program(char *fname)
 {
+	struct lc_program *pg;
 	FILE *fp;
-	int i;
-
-	if (fopen_s(&fp, fname, "rb") != 0 || fp == NULL) return 0;
-
-	i = 0;
-	do {
-		*p = (char)getc(fp);
-		p++; i++;
-	} while (!feof(fp) && i < PROG_SIZE);
+	char *p;
+	long size;
+	int c;
+
+	pg = lc->pg;
+	if (fopen_s(&fp, fname, "rb") != 0 || fp == NULL) return NULL;
+
+	/* size the buffer from the file, when it can be seeked */
+	size = -1;
+	if (fseek(fp, 0, SEEK_END) == 0) {
+		size = ftell(fp);
+		rewind(fp);
+	}
+	if (size < 0) size = 4096;
 
-	if (*(p - 2) == 0x1a) *(p - 2) = '\0'; /* null terminate the program */
-	else *(p - 1) = '\0';
+	p = NULL;
+	pg->p_len = 0;
+	for (;;) {
+		if ((p = (char *)realloc(p, size + LC_PAD)) == NULL) {
+			printf("Allocation Failure");
+			exit(1);
+		}
+		pg->p_len += (int)fread(p + pg->p_len, 1, size - pg->p_len, fp);
+		if (pg->p_len < size || (c = getc(fp)) == EOF) break;
+		p[pg->p_len++] = (char)c; /* the file is longer than it was */
+		size *= 2;
+	}
 	fclose(fp);
-	return 1;
+
+	if (pg->p_len && p[pg->p_len - 1] == 0x1a) pg->p_len--; /* drop a DOS end of file */
+	memset(p + pg->p_len, 0, LC_PAD); /* null terminate the program, and pad it */
+	return p;
 }
 
 /* Find the location of all functions in the program
    and store global variables. */
 void prescan(void)
 {
-	char *p, *tp;
+	struct lc_program *pg;
+	struct token_rec *p, *tp, *name;
 	char temp[ID_LEN + 1];
-	int datatype;
-	int brace = 0;  /* When 0, this var tells us that
-					   current source position is outside
-					   of any function. */
+	int datatype, i;
 
-	p = prog;
-	func_index = 0;
-	do {
-		while (brace) {  /* bypass code inside functions */
-			get_token();
-			if (*token == '{') brace++;
-			if (*token == '}') brace--;
-		}
+	pg = lc->pg;
+	/* start the symbol table with the library functions */
+	pg->sym_table = (struct sym_type *)malloc((pg->id_count + 1) * sizeof(struct sym_type));
+	if (pg->sym_table == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	for (i = 0; i < pg->id_count; i++) {
+		pg->sym_table[i].func = -1;
+		pg->sym_table[i].builtin = internal_func(pg->t_pool + pg->id_text[i]);
+		pg->sym_table[i].global = -1;
+	}
 
-		tp = prog; /* save current position */
+	p = lc->prog;
+	pg->func_index = 0;
+	do {
+		tp = lc->prog; /* save current position */
 		get_token();
 		/* global var type or function return type */
-		if (tok == CHAR || tok == INT) {
-			datatype = tok; /* save data type */
+		if (lc->tok == CHAR || lc->tok == INT) {
+			datatype = lc->tok; /* save data type */
 			get_token();
-			if (token_type == IDENTIFIER) {
-				strcpy_s(temp, ID_LEN + 1, token);
+			if (lc->token_type == IDENTIFIER) {
+				strcpy_s(temp, ID_LEN + 1, lc->token);
+				name = lc->cur_tok;
 				get_token();
-				if (*token != '(') { /* must be global var */
-					prog = tp; /* return to start of declaration */
+				if (*lc->token != '(') { /* must be global var */
+					lc->prog = tp; /* return to start of declaration */
 					decl_global();
 				}
-				else if (*token == '(') {  /* must be a function */
-					func_table[func_index].loc = prog;
-					func_table[func_index].ret_type = datatype;
-					strcpy_s(func_table[func_index].func_name, ID_LEN, temp);
-					func_index++;
-					while (*prog != ')') prog++;
-					prog++;
+				else if (*lc->token == '(') {  /* must be a function */
+					if (pg->func_index == pg->func_size)
+						pg->func_table = (struct func_type *)grow_table(pg->func_table, &pg->func_size,
+							sizeof(struct func_type), INT_MAX, SYNTAX);
+					pg->func_table[pg->func_index].loc = lc->prog;
+					pg->func_table[pg->func_index].ret_type = datatype;
+					strcpy_s(pg->func_table[pg->func_index].func_name, ID_LEN, temp);
+					if (pg->sym_table[name->id].func < 0)
+						pg->sym_table[name->id].func = pg->func_index;
+					pg->func_index++;
+					lc->prog = pg->tok_buf + lc->cur_tok->value + 1; /* skip the parameter list */
 					/* now prog points to opening curly
 					   brace of function */
 				}
 				else putback();
 			}
 		}
-		else if (*token == '{') brace++;
-	} while (tok != FINISHED);
-	prog = p;
+		else if (lc->token_type == BLOCK && *lc->token == '{')
+			lc->prog = pg->tok_buf + lc->cur_tok->value + 1; /* bypass code inside functions */
+	} while (lc->tok != FINISHED);
+	lc->prog = p;
+}
+
+/* Bind every call to the function it calls, and every use
+   of a variable to its slot in the frame of the function it
+   is in or to its index in global_vars, so that nothing has
+   to be looked up by name when the program runs. Parameters
+   take the first slots of a frame, then each local variable
+   takes the next slot in the order it is declared.
+*/
+void resolve(void)
+{
+	struct lc_program *pg;
+	struct token_rec *t;
+	int *slot_id;  /* identifier in each slot */
+	int f, i, nslots, brace, slot_size;
+	char decl;
+
+	pg = lc->pg;
+	slot_id = NULL;
+	slot_size = 0;
+	for (f = 0; f < pg->func_index; f++) {
+		/* check the parameter list once, rather than at each call */
+		lc->prog = pg->func_table[f].loc;
+		do {
+			get_token();
+			if (*lc->token == ')') break;
+			if (lc->tok != INT && lc->tok != CHAR) sntx_err(TYPE_EXPECTED);
+			get_token(); /* the parameter's name */
+			get_token();
+		} while (*lc->token == ',');
+		if (*lc->token != ')') sntx_err(PAREN_EXPECTED);
+		pg->func_table[f].body = lc->prog;
+
+		nslots = 0;
+		brace = 0;
+		decl = 1; /* the parameter list declares variables */
+		for (t = pg->func_table[f].loc; t->tok != FINISHED; t++) {
+			if (t->token_type == BLOCK) {
+				if (pg->t_pool[t->text] == '{') brace++;
+				else if (--brace == 0) break; /* end of function */
+			}
+			else if (t->token_type == KEYWORD && (t->tok == INT || t->tok == CHAR))
+				decl = 1;
+			else if (t->token_type == KEYWORD && (t->tok == FOR || t->tok == WHILE || t->tok == DO))
+				describe_loop(t);
+			else if (t->token_type == KEYWORD && t->tok == RETURN) /* is it return f(...); in f? */
+				t->value = t[1].token_type == IDENTIFIER && pg->sym_table[t[1].id].func == f &&
+					t[2].token_type == DELIMITER && pg->t_pool[t[2].text] == '(' &&
+					pg->tok_buf[t[2].value + 1].token_type == DELIMITER &&
+					pg->t_pool[pg->tok_buf[t[2].value + 1].text] == ';';
+			else if (t->token_type == DELIMITER && (pg->t_pool[t->text] == ';' || pg->t_pool[t->text] == ')')) {
+				if (decl && !brace && pg->t_pool[t->text] == ')')
+					pg->func_table[f].nparams = nslots; /* end of the parameters */
+				decl = 0;
+			}
+			else if (t->token_type == IDENTIFIER) {
+				if (decl) { /* a new variable gets the next slot */
+					if (nslots == slot_size) {
+						set_token(t);
+						slot_id = (int *)grow_table(slot_id, &slot_size, sizeof(int),
+							lc->max_locals, TOO_MANY_LVARS);
+					}
+					slot_id[nslots] = t->id;
+					t->bind = BIND_LOCAL;
+					t->value = nslots++;
+					continue;
+				}
+				if (pg->sym_table[t->id].builtin >= 0) { /* library function */
+					t->bind = BIND_BUILTIN;
+					t->value = pg->sym_table[t->id].builtin;
+					continue;
+				}
+				if (pg->sym_table[t->id].func >= 0) { /* user function */
+					t->bind = BIND_FUNC;
+					t->value = pg->sym_table[t->id].func;
+					continue;
+				}
+				for (i = nslots - 1; i >= 0; i--) /* the latest local wins */
+					if (slot_id[i] == t->id) break;
+				if (i >= 0) {
+					t->bind = BIND_LOCAL;
+					t->value = i;
+					continue;
+				}
+				if (pg->sym_table[t->id].global >= 0) {
+					t->bind = BIND_GLOBAL;
+					t->value = pg->sym_table[t->id].global;
+				}
+			}
+		}
+		pg->func_table[f].nslots = nslots;
+	}
+	free(slot_id);
 }
 
-/* Return the entry point of the specified function.
-   Return NULL if not found.
+/* Fill in the loop_table entry for the loop starting at
+   keyword t, and store its index in t->value.
 */
-char *find_func(char *name)
+void describe_loop(struct token_rec *t)
 {
-	register int i;
+	struct lc_program *pg;
+	struct loop_type *lp;
+	struct token_rec *p;
+	int semi;
+
+	pg = lc->pg;
+	if (t->tok == WHILE && t[-1].token_type == BLOCK && pg->t_pool[t[-1].text] == '}'
+		&& pg->tok_buf[t[-1].value - 1].token_type == KEYWORD && pg->tok_buf[t[-1].value - 1].tok == DO)
+		return; /* the end of a do loop, described with the do */
+
+	if (pg->loop_count == pg->loop_size) { /* grow the loop table */
+		pg->loop_size = pg->loop_size ? pg->loop_size * 2 : 16;
+		pg->loop_table = (struct loop_type *)realloc(pg->loop_table, pg->loop_size * sizeof(struct loop_type));
+		if (pg->loop_table == NULL) {
+			printf("Allocation Failure");
+			exit(1);
+		}
+	}
+	t->value = pg->loop_count;
+	lp = &pg->loop_table[pg->loop_count++];
+	lp->incr = NULL;
+
+	if (t->tok == DO) {
+		lp->body = t + 1;
+		if (lp->body->token_type != BLOCK || pg->t_pool[lp->body->text] != '{') {
+			set_token(lp->body);
+			sntx_err(SYNTAX);
+		}
+		p = pg->tok_buf + lp->body->value + 1; /* just past the matching } */
+		if (p->token_type != KEYWORD || p->tok != WHILE) {
+			set_token(p);
+			sntx_err(WHILE_EXPECTED);
+		}
+		lp->cond = ++p;
+		if (p->token_type != DELIMITER || pg->t_pool[p->text] != '(') {
+			set_token(p);
+			sntx_err(PAREN_EXPECTED);
+		}
+		p = pg->tok_buf + p->value + 1; /* past the condition */
+		lp->exit = pg->t_pool[p->text] == ';' ? p + 1 : p;
+		return;
+	}
+
+	p = t + 1;
+	if (p->token_type != DELIMITER || pg->t_pool[p->text] != '(') {
+		set_token(p);
+		sntx_err(PAREN_EXPECTED);
+	}
+	lp->body = pg->tok_buf + p->value + 1; /* just past the matching ) */
+	if (t->tok == WHILE) lp->cond = p;
+	else { /* find the two semicolons of the for */
+		semi = 0;
+		for (p++; p < lp->body - 1 && semi < 2; p++) {
+			if (pg->t_pool[p->text] == '(' && p->token_type == DELIMITER)
+				p = pg->tok_buf + p->value;
+			else if (pg->t_pool[p->text] == ';' && p->token_type == DELIMITER) {
+				if (semi++) lp->incr = p + 1;
+				else lp->cond = p + 1;
+			}
+		}
+		if (semi < 2) {
+			set_token(p);
+			sntx_err(SEMI_EXPECTED);
+		}
+	}
+	if (lp->body->token_type != BLOCK || pg->t_pool[lp->body->text] != '{') {
+		set_token(lp->body);
+		sntx_err(SYNTAX);
+	}
+	lp->exit = pg->tok_buf + lp->body->value + 1; /* just past the matching } */
+}
 
-	for (i = 0; i < func_index; i++)
-		if (!strcmp(name, func_table[i].func_name))
-			return func_table[i].loc;
+/* Return the index in func_table of the specified function.
+   Return -1 if not found.
+*/
+int find_func(char *name)
+{
+	int id;
 
-	return NULL;
+	COUNT(func_lookups);
+	id = find_ident(name);
+	return id < 0 ? -1 : lc->pg->sym_table[id].func;
 }
 
 /* Declare a global variable. */
 void decl_global(void)
 {
+	struct lc_program *pg;
 	int vartype;
 
+	pg = lc->pg;
 	get_token();  /* get type */
 
-	vartype = tok; /* save var type */
+	vartype = lc->tok; /* save var type */
 
 	do { /* process comma-separated list */
-		global_vars[gvar_index].v_type = vartype;
-		global_vars[gvar_index].value = 0;  /* init to 0 */
+		if (pg->gvar_index == pg->gvar_size)
+			pg->global_vars = (struct var_type *)grow_table(pg->global_vars, &pg->gvar_size,
+				sizeof(struct var_type), lc->max_globals, TOO_MANY_GVARS);
+		pg->global_vars[pg->gvar_index].v_type = vartype;
+		pg->global_vars[pg->gvar_index].value = 0;  /* init to 0 */
 		get_token();  /* get name */
-		strcpy_s(global_vars[gvar_index].var_name, ID_LEN, token);
+		if (lc->token_type != IDENTIFIER) sntx_err(SYNTAX);
+		pg->global_vars[pg->gvar_index].id = lc->cur_tok->id;
+		if (pg->sym_table[lc->cur_tok->id].global < 0) /* the first declaration wins */
+			pg->sym_table[lc->cur_tok->id].global = pg->gvar_index;
 		get_token();
-		gvar_index++;
-	} while (*token == ',');
-	if (*token != ';') sntx_err(SEMI_EXPECTED);
+		pg->gvar_index++;
+	} while (*lc->token == ',');
+	if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
 }
 
-/* Declare a local variable. */
+/* Declare a local variable. Each variable already has
+   a slot in the function's frame, which is set to 0. */
 void decl_local(void)
 {
-	struct var_type i;
-
 	get_token();  /* get type */
 
-	i.v_type = tok;
-	i.value = 0;  /* init to 0 */
-
 	do { /* process comma-separated list */
 		get_token(); /* get var name */
-		strcpy_s(i.var_name, ID_LEN, token);
-		local_push(i);
+		if (lc->cur_tok->bind != BIND_LOCAL) sntx_err(SYNTAX);
+		lc->local_var_stack[lc->frame + lc->cur_tok->value] = 0;
 		get_token();
-	} while (*token == ',');
-	if (*token != ';') sntx_err(SEMI_EXPECTED);
+	} while (*lc->token == ',');
+	if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
 }
 
-/* Call a function. */
-void call(void)
+/* Call function f in func_table. Its frame starts with
+   the arguments, and is laid out from the function's
+   descriptor. A tail call of f from itself runs it again
+   here, in the same frame.
+*/
+void call(int f)
 {
-	char *loc, *temp;
-	int lvartemp;
-
-	loc = find_func(token); /* find entry point of function */
-	if (loc == NULL)
-		sntx_err(FUNC_UNDEF); /* function not defined */
-	else {
-		lvartemp = lvartos;  /* save local var stack index */
-		get_args();  /* get function arguments */
-		temp = prog; /* save return location */
-		func_push(lvartemp);  /* save local var stack index */
-		prog = loc;  /* reset prog to start of function */
-		ret_occurring = 0; /* P the return occurring variable */
-		get_params(); /* load the function's parameters with the values of the arguments */
+	struct token_rec *temp;
+	struct func_type *fn;
+	int base, caller, n;
+
+	COUNT(calls);
+	fn = &lc->pg->func_table[f];
+	base = lc->lvartos;  /* save local var stack index */
+	get_args();  /* get function arguments */
+	temp = lc->prog; /* save return location */
+	func_push(base);  /* save local var stack index */
+	caller = lc->frame;
+	lc->frame = base;
+	if (lc->prof) prof_enter(f, 0);
+	do {
+		n = lc->lvartos - base;
+		if (n > fn->nparams) n = fn->nparams; /* drop any extra arguments */
+		while (lc->lvar_size < base + fn->nslots)
+			lc->local_var_stack = (int *)grow_table(lc->local_var_stack, &lc->lvar_size,
+				sizeof(int), lc->max_locals, TOO_MANY_LVARS);
+		memset(lc->local_var_stack + base + n, 0, (fn->nslots - n) * sizeof(int)); /* a missing argument is 0 */
+		lc->lvartos = base + fn->nslots;
+		COUNT_MAX(max_lvartos, lc->lvartos);
+
+		lc->prog = fn->body;  /* reset prog to start of function */
+		lc->ret_occurring = 0; /* P the return occurring variable */
+		lc->tail_occurring = 0;
 		interp_block(); /* interpret the function */
-		ret_occurring = 0; /* Clear the return occurring variable */
-		prog = temp; /* reset the program pointer */
-		lvartos = func_pop(); /* reset the local var stack */
-	}
+		if (lc->break_occurring || lc->cont_occurring) {
+			/* a break or continue outside a loop ends the function */
+			lc->break_occurring = lc->cont_occurring = 0;
+			lc->ret_value = 0;
+		}
+		if (lc->prof && lc->tail_occurring) prof_enter(f, 1);
+	} while (lc->tail_occurring);
+	if (lc->prof) prof_leave();
+	lc->ret_occurring = 0; /* Clear the return occurring variable */
+	lc->prog = temp; /* reset the program pointer */
+	lc->frame = caller;
+	lc->lvartos = func_pop(); /* reset the local var stack */
 }
 
 /* Push the arguments to a function onto the local
-   variable stack. */
+   variable stack, so that argument n is in slot n of
+   the function's frame. */
 void get_args(void)
 {
-	int value, count, temp[NUM_PARAMS];
-	struct var_type i;
+	int value;
 
-	count = 0;
 	get_token();
-	if (*token != '(') sntx_err(PAREN_EXPECTED);
+	if (*lc->token != '(') sntx_err(PAREN_EXPECTED);
 
 	/* process a comma-separated list of values */
 	do {
 		eval_exp(&value);
-		temp[count] = value;  /* save temporarily */
-		get_token();
-		count++;
-	} while (*token == ',');
-	count--;
-	/* now, push on local_var_stack in reverse order */
-	for (; count >= 0; count--) {
-		i.value = temp[count];
-		i.v_type = ARG;
-		local_push(i);
-	}
-}
-
-/* Get function parameters. */
-void get_params(void)
-{
-	struct var_type *p;
-	int i;
-
-	i = lvartos - 1;
-	do { /* process comma-separated list of parameters */
+		local_push(value);
 		get_token();
-		p = &local_var_stack[i];
-		if (*token != ')') {
-			if (tok != INT && tok != CHAR)
-				sntx_err(TYPE_EXPECTED);
-
-			p->v_type = token_type;
-			get_token();
-
-			/* link parameter name with argument already on
-			   local var stack */
-			strcpy_s(p->var_name, ID_LEN, token);
-			get_token();
-			i--;
-		}
-		else break;
-	} while (*token == ',');
-	if (*token != ')') sntx_err(PAREN_EXPECTED);
+	} while (*lc->token == ',');
 }
 
-/* Return from a function. */
+/* Return from a function. For a tail call, the arguments
+   replace those of the function that is returning, for
+   call() to run it again.
+*/
 void func_ret(void)
 {
-	int value;
+	int value, top, base;
+
+	if (lc->cur_tok->value) { /* return f(...); in f */
+		get_token(); /* the function's name */
+		top = lc->lvartos;
+		get_args();
+		base = lc->frame;
+		memmove(&lc->local_var_stack[base], &lc->local_var_stack[top],
+			(lc->lvartos - top) * sizeof(int));
+		lc->lvartos = base + lc->lvartos - top;
+		lc->tail_occurring = 1;
+		return;
+	}
 
 	value = 0;
 	/* get return value, if any */
 	eval_exp(&value);
 
-	ret_value = value;
+	lc->ret_value = value;
 }
 
 /* Push a local variable. */
-void local_push(struct var_type i)
+void local_push(int value)
 {
-	if (lvartos >= NUM_LOCAL_VARS) {
-		sntx_err(TOO_MANY_LVARS);
-	}
-	else {
-		local_var_stack[lvartos] = i;
-		lvartos++;
-	}
+	if (lc->lvartos == lc->lvar_size)
+		lc->local_var_stack = (int *)grow_table(lc->local_var_stack, &lc->lvar_size,
+			sizeof(int), lc->max_locals, TOO_MANY_LVARS);
+	lc->local_var_stack[lc->lvartos++] = value;
+	COUNT_MAX(max_lvartos, lc->lvartos);
 }
 
 /* Pop index into local variable stack. */
 int func_pop(void)
 {
-	int index = 0;
-	functos--;
-	if (functos < 0) {
-		sntx_err(RET_NOCALL);
-	}
-	else if (functos >= NUM_FUNC) {
-		sntx_err(NEST_FUNC);
-	}
-	else {
-		index = call_stack[functos];
-	}
-
-	return index;
+	if (lc->functos == 0) sntx_err(RET_NOCALL);
+	return lc->call_stack[--lc->functos];
 }
 
 /* Push index of local variable stack. */
 void func_push(int i)
 {
-	if (functos >= NUM_FUNC) {
-		sntx_err(NEST_FUNC);
-	}
-	else {
-		call_stack[functos] = i;
-		functos++;
-	}
+	if (lc->functos == lc->call_size)
+		lc->call_stack = (int *)grow_table(lc->call_stack, &lc->call_size,
+			sizeof(int), lc->max_calls, NEST_FUNC);
+	lc->call_stack[lc->functos++] = i;
+	COUNT_MAX(max_functos, lc->functos);
 }
 
-/* Assign a value to a variable. */
-void assign_var(char *var_name, int value)
+/* Make room in a table that has size entries of elem
+   bytes for at least one more, doubling its size up to
+   limit entries. Return the table, which may have moved.
+   Report error if the table already has limit entries.
+*/
+void *grow_table(void *table, int *size, int elem, int limit, int error)
 {
-	register int i;
+	int n;
 
-	/* first, see if it's a local variable */
-	for (i = lvartos - 1; i >= call_stack[functos - 1]; i--) {
-		if (!strcmp(local_var_stack[i].var_name, var_name)) {
-			local_var_stack[i].value = value;
-			return;
-		}
+	if (*size >= limit) sntx_err(error);
+	n = *size ? *size : 8;
+	n = n > limit / 2 ? limit : n * 2;
+	table = realloc(table, (size_t)n * elem);
+	if (table == NULL) {
+		printf("Allocation Failure");
+		exit(1);
 	}
-	if (i < call_stack[functos - 1])
-		/* if not local, try global var table */
-		for (i = 0; i < NUM_GLOBAL_VARS; i++)
-			if (!strcmp(global_vars[i].var_name, var_name)) {
-				global_vars[i].value = value;
-				return;
-			}
-	sntx_err(NOT_VAR); /* variable not found */
+	*size = n;
+	return table;
 }
 
-/* Find the value of a variable. */
-int find_var(char *s)
+/* Assign a value to the variable token t names. */
+void assign_var(struct token_rec *t, int value)
 {
-	register int i;
-
-	/* first, see if it's a local variable */
-	for (i = lvartos - 1; i >= call_stack[functos - 1]; i--)
-		if (!strcmp(local_var_stack[i].var_name, token))
-			return local_var_stack[i].value;
+	COUNT(var_lookups);
+	if (t->bind == BIND_LOCAL) {
+		lc->local_var_stack[lc->frame + t->value] = value;
+		return;
+	}
+	else if (t->bind == BIND_GLOBAL) {
+		lc->globals[t->value] = value;
+		return;
+	}
+	sntx_err(NOT_VAR); /* variable not found */
+}
 
-	/* otherwise, try global vars */
-	for (i = 0; i < NUM_GLOBAL_VARS; i++)
-		if (!strcmp(global_vars[i].var_name, s))
-			return global_vars[i].value;
+/* Find the value of the variable token t names. */
+int find_var(struct token_rec *t)
+{
+	COUNT(var_lookups);
+	if (t->bind == BIND_LOCAL)
+		return lc->local_var_stack[lc->frame + t->value];
+	else if (t->bind == BIND_GLOBAL)
+		return lc->globals[t->value];
 
 	sntx_err(NOT_VAR); /* variable not found */
 	return -1;
 }
 
-/* Determine if an identifier is a variable. Return
+/* Determine if token t names a variable. Return
    1 if variable is found; 0 otherwise.
 */
-int is_var(char *s)
+int is_var(struct token_rec *t)
 {
-	register int i;
-
-	/* first, see if it's a local variable */
-	for (i = lvartos - 1; i >= call_stack[functos - 1]; i--)
-		if (!strcmp(local_var_stack[i].var_name, token))
-			return 1;
-
-	/* otherwise, try global vars */
-	for (i = 0; i < NUM_GLOBAL_VARS; i++)
-		if (!strcmp(global_vars[i].var_name, s))
-			return 1;
-
-	return 0;
+	COUNT(var_lookups);
+	return t->bind != BIND_NONE;
 }
 
 /* Execute an if statement. */
@@ -570,13 +1025,8 @@ void exec_if(void)
 	else { /* otherwise skip around IF block and
 		   process the ELSE, if present */
 		find_eob(); /* find start of next line */
+		if (PEEK()->tok != ELSE) return; /* no ELSE is present */
 		get_token();
-
-		if (tok != ELSE) {
-			putback();  /* restore token if
-						   no ELSE is present */
-			return;
-		}
 		interp_block();
 	}
 }
@@ -585,110 +1035,2362 @@ void exec_if(void)
 void exec_while(void)
 {
 	int cond;
-	char *temp;
+	struct loop_type *lp;
 
-	break_occurring = 0; /* clear the break flag */
-	putback();
-	temp = prog;  /* save location of top of while loop */
-	get_token();
-	eval_exp(&cond);  /* check the conditional expression */
-	if (cond) {
+	lp = &lc->pg->loop_table[lc->cur_tok->value];
+	for (;;) {
+		if (lc->prof) prof_tick(lp->cond->line, 0);
+		lc->prog = lp->cond;
+		eval_exp(&cond);  /* check the conditional expression */
+		if (!cond) break;
+		lc->prog = lp->body;
 		interp_block();  /* if true, interpret */
-		if (break_occurring > 0) {
-			break_occurring = 0;
-			return;
+		if (lc->ret_occurring > 0) return;
+		lc->cont_occurring = 0;
+		if (lc->break_occurring > 0) {
+			lc->break_occurring = 0;
+			break;
 		}
 	}
-	else {  /* otherwise, skip around loop */
-		find_eob();
-		return;
-	}
-	prog = temp;  /* loop back to top */
+	lc->prog = lp->exit;  /* continue after the loop */
 }
 
 /* Execute a do loop. */
 void exec_do(void)
 {
 	int cond;
-	char *temp;
-
-	putback();
-	temp = prog;  /* save location of top of do loop */
-	break_occurring = 0; /* clear the break flag */
+	struct loop_type *lp;
 
-	get_token(); /* get start of loop */
-	interp_block(); /* interpret loop */
-	if (ret_occurring > 0) {
-		return;
-	}
-	else if (break_occurring > 0) {
-		break_occurring = 0;
-		return;
-	}
-	get_token();
-	if (tok != WHILE) sntx_err(WHILE_EXPECTED);
-	eval_exp(&cond); /* check the loop condition */
-	if (cond) prog = temp; /* if true loop; otherwise,
-							 continue on */
+	lp = &lc->pg->loop_table[lc->cur_tok->value];
+	do {
+		lc->prog = lp->body;
+		interp_block(); /* interpret loop */
+		if (lc->ret_occurring > 0) return;
+		lc->cont_occurring = 0;
+		if (lc->break_occurring > 0) {
+			lc->break_occurring = 0;
+			break;
+		}
+		if (lc->prof) prof_tick(lp->cond->line, 0);
+		lc->prog = lp->cond;
+		eval_exp(&cond); /* check the loop condition */
+	} while (cond);
+	lc->prog = lp->exit;  /* continue after the loop */
 }
 
 /* Find the end of a block. */
 void find_eob(void)
 {
-	int brace;
-
 	get_token();
-	brace = 1;
-	do {
-		get_token();
-		if (*token == '{') brace++;
-		else if (*token == '}') brace--;
-	} while (brace);
+	if (lc->token_type != BLOCK || *lc->token != '{') sntx_err(SYNTAX);
+	lc->prog = lc->pg->tok_buf + lc->cur_tok->value + 1; /* just past the matching } */
 }
 
 /* Execute a for loop. */
 void exec_for(void)
 {
 	int cond;
-	char *temp, *temp2;
-	int brace;
+	struct loop_type *lp;
 
-	break_occurring = 0; /* clear the break flag */
-	get_token();
+	lp = &lc->pg->loop_table[lc->cur_tok->value];
+	get_token(); /* the ( */
 	eval_exp(&cond);  /* initialization expression */
-	if (*token != ';') sntx_err(SEMI_EXPECTED);
-	prog++; /* get past the ; */
-	temp = prog;
+	if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
 	for (;;) {
+		if (lc->prof) prof_tick(lp->cond->line, 0);
+		lc->prog = lp->cond;
 		eval_exp(&cond);  /* check the condition */
-		if (*token != ';') sntx_err(SEMI_EXPECTED);
-		prog++; /* get past the ; */
-		temp2 = prog;
-
-		/* find the start of the for block */
-		brace = 1;
-		while (brace) {
-			get_token();
-			if (*token == '(') brace++;
-			if (*token == ')') brace--;
-		}
-
-		if (cond) {
-			interp_block();  /* if true, interpret */
-			if (ret_occurring > 0) {
-				return;
-			}
-			else if (break_occurring > 0) {
-				break_occurring = 0;
-				return;
-			}
-		}
-		else {  /* otherwise, skip around loop */
-			find_eob();
-			return;
+		if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
+		if (!cond) break;
+		lc->prog = lp->body;
+		interp_block();  /* if true, interpret */
+		if (lc->ret_occurring > 0) return;
+		lc->cont_occurring = 0;
+		if (lc->break_occurring > 0) {
+			lc->break_occurring = 0;
+			break;
 		}
-		prog = temp2;
+		if (lc->prof) prof_tick(lp->incr->line, 0);
+		lc->prog = lp->incr;
 		eval_exp(&cond); /* do the increment */
-		prog = temp;  /* loop back to top */
+	}
+	lc->prog = lp->exit;  /* continue after the loop */
+}
+
+/****** Profiler *******/
+
+/* With --profile=FILE the token walking interpreter counts the
+   calls of each function and the statements run on each line,
+   and times them. Time is charged, whenever a statement starts,
+   to the line and function of the statement before, so each
+   line's time is that of its own statements and each function's
+   self time that of its own lines; a function's total time also
+   takes in the functions it calls. When the program stops, the
+   counts are written to FILE, the most costly first.
+*/
+
+struct prof_func {
+	long calls;
+	int active;        /* calls of the function in progress */
+	double total, self;
+};
+
+struct prof_line {
+	long count;        /* statements run on the line */
+	double self;
+};
+
+struct prof_frame {    /* what a call interrupted */
+	int func, line;
+	double start;
+};
+
+struct lc_profile {
+	struct prof_func *funcs;
+	struct prof_line *lines;
+	int nlines;
+	int func, line;    /* the function and line running */
+	double start, last; /* when the run started and time was last charged */
+	struct prof_frame *stack;
+	int depth, size;
+};
+
+struct prof_row {      /* a line of the report */
+	int index;
+	long count;
+	double total, self;
+};
+
+/* Return the time in seconds, as precisely as it can be had. */
+static double prof_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Start profiling a run. */
+void prof_start(void)
+{
+	struct lc_profile *p;
+
+	if (lc->profile == NULL) return;
+	p = (struct lc_profile *)calloc(1, sizeof(struct lc_profile));
+	if (p == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	p->nlines = lc->pg->tok_buf[lc->pg->tok_count - 1].line + 1;
+	p->funcs = (struct prof_func *)calloc(lc->pg->func_index + 1, sizeof(struct prof_func));
+	p->lines = (struct prof_line *)calloc(p->nlines, sizeof(struct prof_line));
+	if (p->funcs == NULL || p->lines == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	p->func = lc->pg->func_index; /* not in any function yet */
+	p->start = p->last = prof_clock();
+	lc->prof = p;
+}
+
+/* Charge the time since the last charge to the line and
+   function running, and go on with line. count is 1 if a
+   statement starts there.
+*/
+void prof_tick(int line, int count)
+{
+	struct lc_profile *p;
+	double now;
+
+	p = lc->prof;
+	now = prof_clock();
+	p->lines[p->line].self += now - p->last;
+	p->funcs[p->func].self += now - p->last;
+	p->last = now;
+	p->line = line;
+	p->lines[line].count += count;
+}
+
+/* Count a call of function f. A tail call runs in place of
+   the call that made it, so it is only counted.
+*/
+void prof_enter(int f, int tail)
+{
+	struct lc_profile *p;
+
+	p = lc->prof;
+	p->funcs[f].calls++;
+	if (tail) return;
+	prof_tick(p->line, 0);
+	if (p->depth == p->size)
+		p->stack = (struct prof_frame *)grow_table(p->stack, &p->size,
+			sizeof(struct prof_frame), INT_MAX, NEST_FUNC);
+	p->stack[p->depth].func = p->func;
+	p->stack[p->depth].line = p->line;
+	p->stack[p->depth].start = p->last;
+	p->depth++;
+	p->funcs[f].active++;
+	p->func = f;
+}
+
+/* Return from the function running. */
+void prof_leave(void)
+{
+	struct lc_profile *p;
+	struct prof_frame *fr;
+
+	p = lc->prof;
+	prof_tick(p->line, 0);
+	fr = &p->stack[--p->depth];
+	if (--p->funcs[p->func].active == 0) /* the outermost call, when it recurses */
+		p->funcs[p->func].total += p->last - fr->start;
+	p->func = fr->func;
+	p->line = fr->line;
+}
+
+/* Order rows by their time, then their count. */
+static int prof_order(const void *a, const void *b)
+{
+	const struct prof_row *x = (const struct prof_row *)a, *y = (const struct prof_row *)b;
+
+	if (x->self != y->self) return x->self < y->self ? 1 : -1;
+	if (x->count != y->count) return x->count < y->count ? 1 : -1;
+	return x->index - y->index;
+}
+
+/* Write the profile, and stop profiling. */
+void prof_stop(void)
+{
+	struct lc_profile *p;
+	struct prof_row *rows;
+	FILE *fp;
+	char *s, *e, **text;
+	int i, n, line;
+
+	if ((p = lc->prof) == NULL) return;
+	while (p->depth > 0) prof_leave(); /* the calls that end stopped */
+	lc->prof = NULL;
+
+	if (fopen_s(&fp, lc->profile, "w") != 0 || fp == NULL) {
+		fprintf(stderr, "cannot write the profile to %s\n", lc->profile);
+		fp = NULL;
+	}
+	n = p->nlines > lc->pg->func_index ? p->nlines : lc->pg->func_index;
+	rows = (struct prof_row *)malloc((n + 1) * sizeof(struct prof_row));
+	if (rows == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	if (fp) {
+		fprintf(fp, "Profile of a run of %.3f ms\n\n", (p->last - p->start) * 1000);
+		fprintf(fp, "Functions, by the time spent in each\n\n");
+		fprintf(fp, "%10s %12s %12s  %s\n", "calls", "total ms", "self ms", "function");
+		for (i = n = 0; i < lc->pg->func_index; i++) {
+			if (p->funcs[i].calls == 0) continue;
+			rows[n].index = i;
+			rows[n].count = p->funcs[i].calls;
+			rows[n].total = p->funcs[i].total;
+			rows[n].self = p->funcs[i].self;
+			n++;
+		}
+		qsort(rows, n, sizeof(struct prof_row), prof_order);
+		for (i = 0; i < n; i++)
+			fprintf(fp, "%10ld %12.3f %12.3f  %s\n", rows[i].count, rows[i].total * 1000,
+				rows[i].self * 1000, lc->pg->func_table[rows[i].index].func_name);
+
+		fprintf(fp, "\nLines, by the time spent in their statements\n\n");
+		fprintf(fp, "%10s %12s %12s  %s\n", "line", "statements", "self ms", "source");
+		for (i = 1, n = 0; i < p->nlines; i++) {
+			if (p->lines[i].count == 0 && p->lines[i].self == 0) continue;
+			rows[n].index = i;
+			rows[n].count = p->lines[i].count;
+			rows[n].self = p->lines[i].self;
+			n++;
+		}
+		qsort(rows, n, sizeof(struct prof_row), prof_order);
+		if ((text = (char **)malloc(p->nlines * sizeof(char *))) == NULL) {
+			printf("Allocation Failure");
+			exit(1);
+		}
+		text[1] = s = lc->pg->p_buf; /* find each line, as sntx_err() counts them */
+		for (line = 2; line < p->nlines; line++) {
+			while (*s && *s != '\n') s++;
+			if (*s) s++;
+			text[line] = s;
+		}
+		for (i = 0; i < n; i++) {
+			s = text[rows[i].index];
+			while (*s == ' ' || *s == '\t') s++;
+			for (e = s; *e && *e != '\n' && *e != '\r' && e - s < 50; e++);
+			fprintf(fp, "%10d %12ld %12.3f  %.*s\n", rows[i].index, rows[i].count,
+				rows[i].self * 1000, (int)(e - s), s);
+		}
+		free(text);
+		fclose(fp);
+	}
+	free(rows);
+	free(p->funcs);
+	free(p->lines);
+	free(p->stack);
+	free(p);
+}
+
+/****** Bytecode Engine *******/
+
+/* With --engine=vm every function in func_table is compiled
+   into code for a small stack machine, which is then run in
+   place of the token walking interpreter above. The token
+   interpreter remains the reference for how programs behave.
+*/
+
+/* Operations of the stack machine. The operands of an
+   operation follow it in the code.
+*/
+enum vm_ops {
+	OP_PUSH,    /* value: push a constant */
+	OP_LOAD,    /* slot: push a local variable */
+	OP_STORE,   /* slot: store the top of the stack in a local */
+	OP_GLOAD,   /* index: push a global variable */
+	OP_GSTORE,  /* index: store the top of the stack in a global */
+	OP_POP,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_NEG,
+	OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+	OP_JMP,     /* target */
+	OP_JZ,      /* target: pop, jump if zero */
+	OP_JNZ,     /* target: pop, jump if not zero */
+	OP_JLT, OP_JLE, OP_JGT, OP_JGE, OP_JEQ, OP_JNE, /* target: pop two, compare, jump if true */
+	OP_ADDSTORE, /* slot, slot, slot: store the sum of two locals in a third */
+	OP_INC,     /* slot, value: add a constant to a local */
+	OP_GINC,    /* index, value: add a constant to a global */
+	OP_CALL,    /* function, argument count */
+	OP_RET,     /* return the top of the stack */
+	OP_TAILCALL, /* function, argument count: run the function again in its frame */
+	OP_GETCHE, OP_GETNUM, OP_PUTCH,
+	OP_PUTS,    /* string: puts() a string constant */
+	OP_PRINTS,  /* string: print() a string constant */
+	OP_PRINTN,  /* print() the top of the stack */
+	OP_END,
+	OP_ERR      /* error: report a syntax error at run time */
+};
+
+/* operand words, values used from the stack and change in
+   depth of the stack of each operation, with those of a call
+   depending on its argument count
+*/
+static const signed char vm_words[] = {
+	1, 1, 1, 1, 1, 0,    0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0,
+	1, 1, 1,    1, 1, 1, 1, 1, 1,    3, 2, 2,
+	2, 0, 2,    0, 0, 0,    1, 1, 0,    0, 1
+};
+static const signed char vm_uses[] = {
+	0, 0, 1, 0, 1, 1,    2, 2, 2, 2, 2, 1,    2, 2, 2, 2, 2, 2,
+	0, 1, 1,    2, 2, 2, 2, 2, 2,    0, 0, 0,
+	0, 1, 0,    0, 0, 1,    0, 0, 1,    0, 0
+};
+static const signed char vm_effect[] = {
+	1, 1, 0, 1, 0, -1,   -1, -1, -1, -1, -1, 0,    -1, -1, -1, -1, -1, -1,
+	0, -1, -1,    -2, -2, -2, -2, -2, -2,    0, 0, 0,
+	1, -1, 0,     1, 1, 0,    1, 1, 0,    0, 1
+};
+
+struct vm_func_type {
+	int entry;   /* offset of the function's code in vm_code */
+	int nparams; /* number of parameters */
+	int nslots;  /* parameters plus local variables */
+	int depth;   /* most values the function puts on the stack */
+};
+
+struct vm_frame { /* saved state of a calling function */
+	int *pc;
+	int bp;      /* offset of the frame in vm_stack, which can move */
+};
+
+void vm_compile(void), vm_stmt(void), vm_exp(void);
+void vm_exp0(void), vm_exp1(void), vm_exp2(void);
+void vm_exp3(void), vm_exp4(void), vm_exp5(void), vm_atom(void);
+void vm_emit(int word), vm_op(int op, int effect), vm_patch(int list, int target);
+void vm_store(struct token_rec *t, int start);
+int vm_jump(int op, int list);
+int vm_run(int f), vm_exec(int f, int base), vm_func_at(int *pc);
+void vm_error(int *pc, int error);
+#ifdef LC_JIT
+char *jit_entry(int f, int *pc);
+int jit_run(int f, char *entry, int base);
+#endif
+
+/* Compile every function in the program. */
+void vm_compile(void)
+{
+	struct lc_program *pg;
+	int f;
+
+	pg = lc->pg;
+	pg->vm_func = (struct vm_func_type *)malloc((pg->func_index + 1) * sizeof(struct vm_func_type));
+	if (pg->vm_func == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	for (f = 0; f < pg->func_index; f++) {
+		lc->prog = pg->func_table[f].body; /* the parameters have the first slots */
+		pg->vm_func[f].entry = pg->vm_len;
+		lc->vm_depth = lc->vm_max_depth = 0;
+		lc->vm_brk = lc->vm_cont = -1;
+		lc->vm_started = 0;
+		lc->vm_last = -1;
+		pg->vm_func[f].nparams = pg->func_table[f].nparams;
+
+		vm_stmt(); /* the body of the function */
+
+		/* a break or continue outside a loop ends the function */
+		vm_patch(lc->vm_brk, pg->vm_len);
+		vm_patch(lc->vm_cont, pg->vm_len);
+		vm_op(OP_PUSH, 1); /* return 0 when the end is reached */
+		vm_emit(0);
+		vm_op(OP_RET, -1);
+
+		pg->vm_func[f].nslots = pg->func_table[f].nslots;
+		pg->vm_func[f].depth = lc->vm_max_depth;
+	}
+}
+
+/* Compile a single statement or block of code. This
+   follows interp_block() one statement at a time.
+*/
+void vm_stmt(void)
+{
+	struct lc_program *pg;
+	int slot, jz, jmp, top, save_brk, save_cont;
+	struct token_rec *incr, *body, *body_end;
+
+	pg = lc->pg;
+	get_token();
+
+	if (lc->token_type == IDENTIFIER) { /* an expression */
+		lc->vm_started = 1;
+		vm_exp0(); /* as vm_exp() would, from the token just read */
+		putback();
+		if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
+		if (lc->vm_last == pg->vm_len - 2 && (pg->vm_code[lc->vm_last] == OP_LOAD
+			|| pg->vm_code[lc->vm_last] == OP_GLOAD)) { /* a value that is not used */
+			pg->vm_len -= 2;
+			lc->vm_depth--;
+		}
+		else vm_op(OP_POP, -1);
+		return;
+	}
+	if (lc->token_type == BLOCK) {
+		if (*lc->token != '{') sntx_err(UNBAL_BRACES);
+		for (;;) {
+			get_token();
+			if (lc->tok == FINISHED) sntx_err(UNBAL_BRACES);
+			if (lc->token_type == BLOCK && *lc->token == '}') return;
+			putback();
+			vm_stmt();
+		}
+	}
+	if (lc->token_type != KEYWORD) return; /* a lone delimiter does nothing */
+
+	switch (lc->tok) {
+	case CHAR:
+	case INT: /* declare local variables */
+		do {
+			get_token(); /* get var name */
+			if (lc->cur_tok->bind != BIND_LOCAL) sntx_err(SYNTAX);
+			slot = lc->cur_tok->value;
+			if (lc->vm_started) { /* a later declaration starts at 0 again */
+				vm_op(OP_PUSH, 1);
+				vm_emit(0);
+				vm_op(OP_STORE, 0);
+				vm_emit(slot);
+				vm_op(OP_POP, -1);
+			}
+			get_token();
+		} while (*lc->token == ',');
+		if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
+		return;
+	case RETURN:
+		lc->vm_started = 1;
+		if (lc->cur_tok->value) { /* a tail call, the last thing compiled */
+			vm_exp();
+			pg->vm_code[pg->vm_len - 3] = OP_TAILCALL;
+			lc->vm_depth--; /* as OP_RET would */
+			return;
+		}
+		vm_exp();
+		vm_op(OP_RET, -1);
+		return;
+	case BREAK:
+	case CONTINUE:
+		if (lc->tok == BREAK) lc->vm_brk = vm_jump(OP_JMP, lc->vm_brk);
+		else lc->vm_cont = vm_jump(OP_JMP, lc->vm_cont);
+		return;
+	case IF:
+		lc->vm_started = 1;
+		vm_exp();
+		jz = vm_jump(OP_JZ, -1);
+		vm_stmt();
+		if (PEEK()->tok != ELSE) {
+			vm_patch(jz, pg->vm_len);
+			return;
+		}
+		get_token();
+		jmp = vm_jump(OP_JMP, -1);
+		vm_patch(jz, pg->vm_len);
+		vm_stmt();
+		vm_patch(jmp, pg->vm_len);
+		return;
+	case ELSE: /* an else without an if is skipped */
+		jmp = vm_jump(OP_JMP, -1);
+		vm_stmt();
+		vm_patch(jmp, pg->vm_len);
+		return;
+	case WHILE:
+		lc->vm_started = 1;
+		save_brk = lc->vm_brk; save_cont = lc->vm_cont;
+		lc->vm_brk = lc->vm_cont = -1;
+		top = pg->vm_len;
+		vm_exp();
+		lc->vm_brk = vm_jump(OP_JZ, lc->vm_brk);
+		vm_stmt();
+		vm_patch(vm_jump(OP_JMP, -1), top);
+		vm_patch(lc->vm_cont, top);
+		vm_patch(lc->vm_brk, pg->vm_len);
+		lc->vm_brk = save_brk; lc->vm_cont = save_cont;
+		return;
+	case DO:
+		lc->vm_started = 1;
+		save_brk = lc->vm_brk; save_cont = lc->vm_cont;
+		lc->vm_brk = lc->vm_cont = -1;
+		top = pg->vm_len;
+		vm_stmt();
+		vm_patch(lc->vm_cont, pg->vm_len);
+		get_token();
+		if (lc->tok != WHILE) sntx_err(WHILE_EXPECTED);
+		vm_exp();
+		vm_patch(vm_jump(OP_JNZ, -1), top);
+		vm_patch(lc->vm_brk, pg->vm_len);
+		lc->vm_brk = save_brk; lc->vm_cont = save_cont;
+		return;
+	case FOR:
+		lc->vm_started = 1;
+		save_brk = lc->vm_brk; save_cont = lc->vm_cont;
+		lc->vm_brk = lc->vm_cont = -1;
+		get_token(); /* the ( */
+		body = pg->tok_buf + lc->cur_tok->value + 1;
+		vm_exp(); /* initialization expression */
+		if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
+		vm_op(OP_POP, -1);
+		lc->prog++; /* get past the ; */
+		top = pg->vm_len;
+		vm_exp(); /* the condition */
+		if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
+		lc->vm_brk = vm_jump(OP_JZ, lc->vm_brk);
+		lc->prog++; /* get past the ; */
+		incr = lc->prog;
+
+		lc->prog = body; /* go to the start of the for block */
+		vm_stmt();
+
+		vm_patch(lc->vm_cont, pg->vm_len);
+		body_end = lc->prog; /* the increment goes after the block */
+		lc->prog = incr;
+		vm_exp();
+		vm_op(OP_POP, -1);
+		lc->prog = body_end;
+		vm_patch(vm_jump(OP_JMP, -1), top);
+		vm_patch(lc->vm_brk, pg->vm_len);
+		lc->vm_brk = save_brk; lc->vm_cont = save_cont;
+		return;
+	case END:
+		vm_op(OP_END, 0);
+		return;
+	}
+}
+
+/* Compile an expression. This follows eval_exp() and
+   leaves the tokens in the same place it does.
+*/
+void vm_exp(void)
+{
+	get_token();
+	if (!*lc->token) sntx_err(NO_EXP);
+	if (*lc->token == ';') {
+		vm_op(OP_PUSH, 1); /* empty expression */
+		vm_emit(0);
+		return;
+	}
+	vm_exp0();
+	putback();
+}
+
+/* Compile an assignment expression. */
+void vm_exp0(void)
+{
+	struct token_rec *temp;
+	int start;
+
+	if (lc->token_type == IDENTIFIER && is_var(lc->cur_tok) && PEEK_TEXT() == '=') {
+		temp = lc->cur_tok; /* an assignment */
+		get_token();
+		get_token();
+		start = lc->pg->vm_len;
+		vm_exp0();
+		vm_store(temp, start);
+		return;
+	}
+	vm_exp1();
+}
+
+/* Compile relational operators. */
+void vm_exp1(void)
+{
+	register char op;
+
+	vm_exp2();
+	op = *lc->token;
+	if (op >= LT && op <= NE) {
+		get_token();
+		vm_exp2();
+		vm_op(OP_LT + op - LT, -1);
+	}
+}
+
+/* Compile adding and subtracting of terms. */
+void vm_exp2(void)
+{
+	register char op;
+
+	vm_exp3();
+	while ((op = *lc->token) == '+' || op == '-') {
+		get_token();
+		vm_exp3();
+		vm_op(op == '+' ? OP_ADD : OP_SUB, -1);
+	}
+}
+
+/* Compile multiplying and dividing of factors. */
+void vm_exp3(void)
+{
+	register char op;
+
+	vm_exp4();
+	while ((op = *lc->token) == '*' || op == '/' || op == '%') {
+		get_token();
+		vm_exp4();
+		vm_op(op == '*' ? OP_MUL : op == '/' ? OP_DIV : OP_MOD, -1);
+	}
+}
+
+/* Compile a unary + or -. */
+void vm_exp4(void)
+{
+	register char op;
+
+	op = '\0';
+	if (lc->token_type == DELIMITER && (*lc->token == '+' || *lc->token == '-')) {
+		op = *lc->token;
+		get_token();
+	}
+	vm_exp5();
+	if (op == '-') vm_op(OP_NEG, 0);
+}
+
+/* Compile a parenthesized expression. */
+void vm_exp5(void)
+{
+	if (*lc->token == '(') {
+		get_token();
+		vm_exp0();
+		if (*lc->token != ')') sntx_err(PAREN_EXPECTED);
+		get_token();
+	}
+	else
+		vm_atom();
+}
+
+/* Compile a number, variable, or function call. */
+void vm_atom(void)
+{
+	int i, count;
+
+	switch (lc->token_type) {
+	case IDENTIFIER:
+		if (lc->cur_tok->bind == BIND_BUILTIN) { /* "standard library" function */
+			if (lc->cur_tok->value == LIB_PUTCH) {
+				vm_exp();
+				vm_op(OP_PUTCH, 0);
+			}
+			else if (lc->cur_tok->value == LIB_PUTS || lc->cur_tok->value == LIB_PRINT) {
+				i = lc->cur_tok->value == LIB_PRINT;
+				get_token();
+				if (*lc->token != '(') sntx_err(PAREN_EXPECTED);
+				get_token();
+				if (lc->token_type == STRING) {
+					vm_op(i ? OP_PRINTS : OP_PUTS, 1);
+					vm_emit(lc->cur_tok->value);
+				}
+				else if (!i) sntx_err(QUOTE_EXPECTED);
+				else { /* print() a number */
+					putback();
+					vm_exp();
+					vm_op(OP_PRINTN, 0);
+				}
+				get_token();
+				if (*lc->token != ')') sntx_err(PAREN_EXPECTED);
+				get_token();
+				if (*lc->token != ';') sntx_err(SEMI_EXPECTED);
+				putback();
+			}
+			else { /* getche() or getnum() */
+				vm_op(lc->cur_tok->value == LIB_GETCHE ? OP_GETCHE : OP_GETNUM, 1);
+				do { /* advance to end of line */
+					get_token();
+				} while (*lc->token != ')' && lc->tok != FINISHED);
+			}
+		}
+		else if (lc->cur_tok->bind == BIND_FUNC) { /* user function */
+			i = lc->cur_tok->value;
+			get_token();
+			if (*lc->token != '(') sntx_err(PAREN_EXPECTED);
+			count = 0;
+			if (lc->prog->token_type != DELIMITER || lc->pg->t_pool[lc->prog->text] != ')') {
+				do { /* process a comma-separated list of values */
+					vm_exp();
+					get_token();
+					count++;
+				} while (*lc->token == ',');
+			}
+			else get_token();
+			vm_op(OP_CALL, 1 - count);
+			vm_emit(i);
+			vm_emit(count);
+		}
+		else if (is_var(lc->cur_tok)) {
+			vm_op(lc->cur_tok->bind == BIND_LOCAL ? OP_LOAD : OP_GLOAD, 1);
+			vm_emit(lc->cur_tok->value);
+		}
+		else { /* not a variable, but only an error if it is run */
+			vm_op(OP_ERR, 1);
+			vm_emit(NOT_VAR);
+		}
+		get_token();
+		return;
+	case NUMBER:
+		vm_op(OP_PUSH, 1);
+		vm_emit(lc->cur_tok->value);
+		get_token();
+		return;
+	case DELIMITER:
+		if (*lc->token == ')') { /* empty expression */
+			vm_op(OP_PUSH, 1);
+			vm_emit(0);
+			return;
+		}
+		sntx_err(SYNTAX);
+	default:
+		sntx_err(SYNTAX);
+	}
+}
+
+/* Add a word to the compiled code. */
+void vm_emit(int word)
+{
+	struct lc_program *pg;
+
+	pg = lc->pg;
+
+	if (pg->vm_len == pg->vm_size) {
+		pg->vm_size = pg->vm_size ? pg->vm_size * 2 : 1024;
+		pg->vm_code = (int *)realloc(pg->vm_code, pg->vm_size * sizeof(int));
+		pg->vm_pos = (int *)realloc(pg->vm_pos, pg->vm_size * sizeof(int));
+		if (pg->vm_code == NULL || pg->vm_pos == NULL) {
+			printf("Allocation Failure");
+			exit(1);
+		}
+	}
+	pg->vm_pos[pg->vm_len] = (int)(lc->cur_tok - pg->tok_buf);
+	pg->vm_code[pg->vm_len++] = word;
+}
+
+/* Compile the store of the value compiled from start on
+   into the variable token t names. x = a + b, for locals,
+   and x = x + n and x = x - n, for a constant n, are each
+   turned into a single operation, followed by a load of x
+   that is dropped again if the value is not used.
+*/
+void vm_store(struct token_rec *t, int start)
+{
+	int *code, a, b;
+
+	code = lc->pg->vm_code + start;
+	if (lc->pg->vm_len - start == 5 && t->bind == BIND_LOCAL && code[0] == OP_LOAD
+		&& code[2] == OP_LOAD && code[4] == OP_ADD) {
+		a = code[1];
+		b = code[3];
+		lc->pg->vm_len = start;
+		lc->vm_depth--;
+		vm_op(OP_ADDSTORE, 0);
+		vm_emit(a);
+		vm_emit(b);
+		vm_emit(t->value);
+	}
+	else if (lc->pg->vm_len - start == 5 && code[0] == (t->bind == BIND_LOCAL ? OP_LOAD : OP_GLOAD)
+		&& code[1] == t->value && code[2] == OP_PUSH
+		&& (code[4] == OP_ADD || (code[4] == OP_SUB && code[3] != INT_MIN))) {
+		b = code[4] == OP_ADD ? code[3] : -code[3];
+		lc->pg->vm_len = start;
+		lc->vm_depth--;
+		vm_op(t->bind == BIND_LOCAL ? OP_INC : OP_GINC, 0);
+		vm_emit(t->value);
+		vm_emit(b);
+	}
+	else {
+		vm_op(t->bind == BIND_LOCAL ? OP_STORE : OP_GSTORE, 0);
+		vm_emit(t->value);
+		return;
+	}
+	vm_op(t->bind == BIND_LOCAL ? OP_LOAD : OP_GLOAD, 1);
+	vm_emit(t->value);
+}
+
+/* Add an operation that changes the number of values on
+   the stack by effect.
+*/
+void vm_op(int op, int effect)
+{
+	lc->vm_last = lc->pg->vm_len;
+	vm_emit(op);
+	lc->vm_depth += effect;
+	if (lc->vm_depth > lc->vm_max_depth) lc->vm_max_depth = lc->vm_depth;
+}
+
+/* Add a jump whose target is not known yet. Jumps waiting
+   for the same target are chained through their operands;
+   return the new head of the chain. A conditional jump on
+   the comparison just compiled becomes a single compare and
+   branch.
+*/
+int vm_jump(int op, int list)
+{
+	static const char inverse[] = { OP_JGE, OP_JGT, OP_JLE, OP_JLT, OP_JNE, OP_JEQ };
+	int cmp;
+
+	if ((op == OP_JZ || op == OP_JNZ) && lc->vm_last == lc->pg->vm_len - 1) {
+		cmp = lc->pg->vm_code[lc->vm_last];
+		if (cmp >= OP_LT && cmp <= OP_NE) {
+			lc->pg->vm_len--;
+			lc->vm_depth++;
+			op = op == OP_JNZ ? OP_JLT + cmp - OP_LT : inverse[cmp - OP_LT];
+		}
+	}
+	vm_op(op, op == OP_JMP ? 0 : op == OP_JZ || op == OP_JNZ ? -1 : -2);
+	vm_emit(list);
+	return lc->pg->vm_len - 1;
+}
+
+/* Point every jump in a chain at target. */
+void vm_patch(int list, int target)
+{
+	int next;
+
+	while (list >= 0) {
+		next = lc->pg->vm_code[list];
+		lc->pg->vm_code[list] = target;
+		list = next;
+	}
+}
+
+/* Report an error at the operation pc points to. */
+void vm_error(int *pc, int error)
+{
+	struct lc_program *pg;
+
+	pg = lc->pg;
+
+	set_token(pg->tok_buf + pg->vm_pos[pc - pg->vm_code]);
+	sntx_err(error);
+}
+
+/* The loop running the code jumps straight from each
+   operation to the next through a table of labels where the
+   compiler allows it, which predicts far better than one
+   switch does, and uses a switch elsewhere. Define LC_SWITCH
+   to use the switch anyway.
+*/
+#ifdef LC_THREADED
+#define VM_LOOP    goto *labels[*pc++];
+#define VM_CASE(op) L_##op
+#define VM_NEXT    goto *labels[*pc++]
+#else
+#define VM_LOOP    for (;;) switch (*pc++)
+#define VM_CASE(op) case op
+#define VM_NEXT    break
+#endif
+
+/* Run function f, which takes no arguments, and return
+   its value.
+*/
+int vm_run(int f)
+{
+	struct vm_func_type *vf;
+	int i;
+
+	vf = &lc->pg->vm_func[f];
+	while (vf->nslots + vf->depth > lc->vm_stack_size)
+		lc->vm_stack = (int *)grow_table(lc->vm_stack, &lc->vm_stack_size, sizeof(int),
+			lc->max_locals, TOO_MANY_LVARS);
+	for (i = 0; i < vf->nslots; i++) lc->vm_stack[i] = 0;
+	lc->vm_fp = 0;
+	COUNT(calls);
+	COUNT_MAX(max_functos, 1);
+	COUNT_MAX(max_lvartos, vf->nslots);
+	return vm_exec(f, 0);
+}
+
+#ifdef LC_JIT
+/* A jump back goes through the JIT, which may take over the loop. */
+#define VM_JUMP { op = pg->vm_code + *pc; if (op < pc) { pc = op; goto back; } pc = op; VM_NEXT; }
+#else
+#define VM_JUMP { pc = pg->vm_code + *pc; VM_NEXT; }
+#endif
+
+/* Run function f, whose frame is at offset base in vm_stack
+   with its arguments and zeroed locals, and return its value.
+   The calls it makes are run here too, except for those that
+   have been compiled to native code. A call from native code
+   runs another one of these.
+*/
+int vm_exec(int f, int base)
+{
+	struct lc_program *pg;
+	register int *pc, *sp;
+	int *bp, *op;
+	int a, b, n, fp, fp0;
+	struct vm_func_type *vf;
+#ifdef LC_JIT
+	char *entry;
+#endif
+#ifdef LC_THREADED
+	static const void *const labels[] = { /* in the order of enum vm_ops */
+		&&L_OP_PUSH, &&L_OP_LOAD, &&L_OP_STORE, &&L_OP_GLOAD, &&L_OP_GSTORE, &&L_OP_POP,
+		&&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_MOD, &&L_OP_NEG,
+		&&L_OP_LT, &&L_OP_LE, &&L_OP_GT, &&L_OP_GE, &&L_OP_EQ, &&L_OP_NE,
+		&&L_OP_JMP, &&L_OP_JZ, &&L_OP_JNZ,
+		&&L_OP_JLT, &&L_OP_JLE, &&L_OP_JGT, &&L_OP_JGE, &&L_OP_JEQ, &&L_OP_JNE,
+		&&L_OP_ADDSTORE, &&L_OP_INC, &&L_OP_GINC,
+		&&L_OP_CALL, &&L_OP_RET, &&L_OP_TAILCALL,
+		&&L_OP_GETCHE, &&L_OP_GETNUM, &&L_OP_PUTCH,
+		&&L_OP_PUTS, &&L_OP_PRINTS, &&L_OP_PRINTN,
+		&&L_OP_END, &&L_OP_ERR
+	};
+#endif
+
+	pg = lc->pg;
+	vf = &pg->vm_func[f];
+	bp = lc->vm_stack + base;
+	sp = bp + vf->nslots;
+	pc = pg->vm_code + vf->entry;
+	fp = fp0 = lc->vm_fp; /* frames below belong to other runs of vm_exec() */
+#ifdef LC_JIT
+	if (lc->jit_funcs != NULL) goto enter;
+#endif
+
+	VM_LOOP {
+	VM_CASE(OP_PUSH):
+		*sp++ = *pc++;
+		VM_NEXT;
+	VM_CASE(OP_LOAD):
+		*sp++ = bp[*pc++];
+		VM_NEXT;
+	VM_CASE(OP_STORE):
+		bp[*pc++] = sp[-1];
+		VM_NEXT;
+	VM_CASE(OP_GLOAD):
+		*sp++ = lc->globals[*pc++];
+		VM_NEXT;
+	VM_CASE(OP_GSTORE):
+		lc->globals[*pc++] = sp[-1];
+		VM_NEXT;
+	VM_CASE(OP_POP):
+		sp--;
+		VM_NEXT;
+	VM_CASE(OP_ADD): sp--; sp[-1] = sp[-1] + *sp; VM_NEXT;
+	VM_CASE(OP_SUB): sp--; sp[-1] = sp[-1] - *sp; VM_NEXT;
+	VM_CASE(OP_MUL): sp--; sp[-1] = sp[-1] * *sp; VM_NEXT;
+	VM_CASE(OP_DIV):
+		sp--;
+		if (*sp == 0) vm_error(pc - 1, DIV_BY_ZERO);
+		if (*sp == -1 && sp[-1] == INT_MIN) vm_error(pc - 1, INT_OVERFLOW);
+		sp[-1] = sp[-1] / *sp;
+		VM_NEXT;
+	VM_CASE(OP_MOD):
+		sp--;
+		if (*sp == 0) vm_error(pc - 1, DIV_BY_ZERO);
+		if (*sp == -1 && sp[-1] == INT_MIN) vm_error(pc - 1, INT_OVERFLOW);
+		sp[-1] = sp[-1] % *sp;
+		VM_NEXT;
+	VM_CASE(OP_NEG): sp[-1] = -sp[-1]; VM_NEXT;
+	VM_CASE(OP_LT): sp--; sp[-1] = sp[-1] < *sp; VM_NEXT;
+	VM_CASE(OP_LE): sp--; sp[-1] = sp[-1] <= *sp; VM_NEXT;
+	VM_CASE(OP_GT): sp--; sp[-1] = sp[-1] > *sp; VM_NEXT;
+	VM_CASE(OP_GE): sp--; sp[-1] = sp[-1] >= *sp; VM_NEXT;
+	VM_CASE(OP_EQ): sp--; sp[-1] = sp[-1] == *sp; VM_NEXT;
+	VM_CASE(OP_NE): sp--; sp[-1] = sp[-1] != *sp; VM_NEXT;
+	VM_CASE(OP_JMP):
+		VM_JUMP;
+	VM_CASE(OP_JZ):
+		if (*--sp == 0) VM_JUMP;
+		pc++;
+		VM_NEXT;
+	VM_CASE(OP_JNZ):
+		if (*--sp != 0) VM_JUMP;
+		pc++;
+		VM_NEXT;
+	VM_CASE(OP_JLT): sp -= 2; if (sp[0] < sp[1]) VM_JUMP; pc++; VM_NEXT;
+	VM_CASE(OP_JLE): sp -= 2; if (sp[0] <= sp[1]) VM_JUMP; pc++; VM_NEXT;
+	VM_CASE(OP_JGT): sp -= 2; if (sp[0] > sp[1]) VM_JUMP; pc++; VM_NEXT;
+	VM_CASE(OP_JGE): sp -= 2; if (sp[0] >= sp[1]) VM_JUMP; pc++; VM_NEXT;
+	VM_CASE(OP_JEQ): sp -= 2; if (sp[0] == sp[1]) VM_JUMP; pc++; VM_NEXT;
+	VM_CASE(OP_JNE): sp -= 2; if (sp[0] != sp[1]) VM_JUMP; pc++; VM_NEXT;
+	VM_CASE(OP_ADDSTORE):
+		bp[pc[2]] = bp[pc[0]] + bp[pc[1]];
+		pc += 3;
+		VM_NEXT;
+	VM_CASE(OP_INC):
+		bp[pc[0]] += pc[1];
+		pc += 2;
+		VM_NEXT;
+	VM_CASE(OP_GINC):
+		lc->globals[pc[0]] += pc[1];
+		pc += 2;
+		VM_NEXT;
+	VM_CASE(OP_CALL):
+		op = pc - 1;
+		f = pc[0];
+		vf = &pg->vm_func[f];
+		n = pc[1];
+		pc += 2;
+		if (fp >= lc->vm_frame_size || sp - n + vf->nslots + vf->depth > lc->vm_stack + lc->vm_stack_size) {
+			set_token(pg->tok_buf + pg->vm_pos[op - pg->vm_code]); /* report a failure here */
+			while (fp >= lc->vm_frame_size)
+				lc->vm_frames = (struct vm_frame *)grow_table(lc->vm_frames, &lc->vm_frame_size,
+					sizeof(struct vm_frame), lc->max_calls, NEST_FUNC);
+			a = (int)(sp - lc->vm_stack);
+			b = (int)(bp - lc->vm_stack);
+			while (a - n + vf->nslots + vf->depth > lc->vm_stack_size)
+				lc->vm_stack = (int *)grow_table(lc->vm_stack, &lc->vm_stack_size, sizeof(int),
+					lc->max_locals, TOO_MANY_LVARS);
+			sp = lc->vm_stack + a;
+			bp = lc->vm_stack + b;
+		}
+		lc->vm_frames[fp].pc = pc;
+		lc->vm_frames[fp].bp = (int)(bp - lc->vm_stack);
+		fp++;
+		bp = sp - n;
+		COUNT(calls);
+		COUNT_MAX(max_functos, fp + 1); /* with main() */
+		COUNT_MAX(max_lvartos, (int)(bp - lc->vm_stack) + vf->nslots);
+		if (n > vf->nparams) sp = bp + vf->nparams; /* drop extra arguments */
+		while (sp < bp + vf->nslots) *sp++ = 0;
+		pc = pg->vm_code + vf->entry;
+#ifdef LC_JIT
+		if (lc->jit_funcs != NULL) goto enter;
+#endif
+		VM_NEXT;
+	VM_CASE(OP_TAILCALL):
+		vf = &pg->vm_func[pc[0]];
+		n = pc[1] < vf->nparams ? pc[1] : vf->nparams; /* drop extra arguments */
+		for (a = 0; a < n; a++) bp[a] = sp[a - pc[1]];
+		sp = bp + n;
+		while (sp < bp + vf->nslots) *sp++ = 0;
+		pc = pg->vm_code + vf->entry;
+		VM_NEXT;
+	VM_CASE(OP_RET):
+		a = sp[-1];
+#ifdef LC_JIT
+	ret: /* return a from the function whose frame is at bp */
+#endif
+		if (fp == fp0) return a;
+		sp = bp;
+		fp--;
+		pc = lc->vm_frames[fp].pc;
+		bp = lc->vm_stack + lc->vm_frames[fp].bp;
+		*sp++ = a;
+		VM_NEXT;
+	VM_CASE(OP_GETCHE):
+		COUNT(builtins);
+		*sp++ = read_char();
+		VM_NEXT;
+	VM_CASE(OP_GETNUM):
+		COUNT(builtins);
+		*sp++ = read_num();
+		VM_NEXT;
+	VM_CASE(OP_PUTCH):
+		COUNT(builtins);
+		out_char(sp[-1]);
+		VM_NEXT;
+	VM_CASE(OP_PUTS):
+		COUNT(builtins);
+		out_string(*pc++);
+		out_char('\n');
+		*sp++ = 0;
+		VM_NEXT;
+	VM_CASE(OP_PRINTS):
+		COUNT(builtins);
+		out_string(*pc++);
+		out_char(' ');
+		*sp++ = 0;
+		VM_NEXT;
+	VM_CASE(OP_PRINTN):
+		COUNT(builtins);
+		out_num(sp[-1]);
+		out_char(' ');
+		sp[-1] = 0;
+		VM_NEXT;
+	VM_CASE(OP_END):
+		stop_program(0);
+	VM_CASE(OP_ERR):
+		vm_error(pc - 1, *pc);
+#ifdef LC_JIT
+	back: /* pc is the target of a jump back */
+		if (lc->jit_funcs == NULL) VM_NEXT;
+		f = vm_func_at(pc);
+	enter: /* pc is the entry of function f, or a loop in it */
+		if ((entry = jit_entry(f, pc)) == NULL) VM_NEXT;
+		lc->vm_fp = fp;
+		b = (int)(bp - lc->vm_stack);
+		a = jit_run(f, entry, b);
+		bp = lc->vm_stack + b; /* the stack may have moved */
+		goto ret;
+#endif
+	}
+	return 0; /* not reached */
+}
+
+/* Return the function whose code pc points into. */
+int vm_func_at(int *pc)
+{
+	struct lc_program *pg;
+	int lo, hi, mid, at;
+
+	pg = lc->pg;
+	at = (int)(pc - pg->vm_code);
+	lo = 0;
+	hi = pg->func_index - 1;
+	while (lo < hi) { /* functions are compiled in order */
+		mid = (lo + hi + 1) / 2;
+		if (pg->vm_func[mid].entry <= at) lo = mid;
+		else hi = mid - 1;
+	}
+	return lo;
+}
+
+/****** Native Code *******/
+
+/* With --jit, on x86-64 Linux, the stack machine counts the
+   calls of each function and the jumps back in its loops. Once
+   these reach JIT_HOT the function is translated, an operation
+   at a time, into native code, which is run from then on; a
+   loop that became hot is continued in native code where it is.
+
+   The native code keeps the same frame the stack machine does:
+   rbx points to it, and the values an operation works on are
+   at fixed places above the locals, since the depth of the
+   stack is known at every operation. Calls, and the library
+   functions, go through the C functions below. A call can move
+   vm_stack, so the frame is found again afterwards from r13,
+   which holds &lc->vm_stack, and r14, the offset of the frame.
+   r15 holds lc->globals.
+
+   The native code of a run is freed when the run ends. A
+   function that cannot be translated is left to the stack
+   machine.
+*/
+
+#ifdef LC_JIT
+
+#ifndef JIT_HOT
+#define JIT_HOT 1000 /* calls and loops before a function is compiled */
+#endif
+
+struct jit_func {
+	char *code;   /* native code, or NULL */
+	size_t size;  /* bytes mapped for it */
+	int *entry;   /* offset in code of each word of the function's
+					 bytecode where it can be entered, or -1 */
+	int hot;      /* calls and jumps back so far */
+	char failed;  /* the function cannot be compiled */
+};
+
+struct jit_buf { /* native code being written */
+	unsigned char *code;
+	int len, size;
+	int *fix;     /* offsets of jumps waiting for their targets */
+	int nfix, fix_size;
+};
+
+int jit_compile(int f);
+int jit_call(int f, int *args, int n, int pos);
+void jit_error(int pos, int error), jit_puts(int s), jit_prints(int s);
+void jit_printn(int n), jit_putch(int c);
+int jit_getche(void), jit_getnum(void);
+
+/* Start a run that may compile functions to native code. */
+void jit_start(void)
+{
+	if (!lc->jit) return;
+	lc->jit_funcs = (struct jit_func *)calloc(lc->pg->func_index + 1, sizeof(struct jit_func));
+	if (lc->jit_funcs == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	lc->jit_compiled = 0;
+}
+
+/* Free the native code of a run. */
+void jit_stop(void)
+{
+	int f;
+
+	if (lc->jit_funcs == NULL) return;
+	if (lc->stats) fprintf(stderr, "jit: %d functions compiled\n", lc->jit_compiled);
+	for (f = 0; f < lc->pg->func_index; f++) {
+		if (lc->jit_funcs[f].code) munmap(lc->jit_funcs[f].code, lc->jit_funcs[f].size);
+		free(lc->jit_funcs[f].entry);
+	}
+	free(lc->jit_funcs);
+	lc->jit_funcs = NULL;
+}
+
+/* Return the native code to run function f from pc on, which
+   is its entry or the top of a loop, compiling the function
+   if it has become hot. Return NULL to go on with the stack
+   machine.
+*/
+char *jit_entry(int f, int *pc)
+{
+	struct jit_func *jf;
+	int at;
+
+	jf = &lc->jit_funcs[f];
+	if (jf->code == NULL) {
+		if (jf->failed || ++jf->hot < JIT_HOT) return NULL;
+		if (!jit_compile(f)) {
+			jf->failed = 1;
+			return NULL;
+		}
+	}
+	at = jf->entry[pc - lc->pg->vm_code - lc->pg->vm_func[f].entry];
+	return at < 0 ? NULL : jf->code + at;
+}
+
+/* Run the native code of function f from entry, with its
+   frame at offset base in vm_stack, and return the value
+   the function returns.
+*/
+int jit_run(int f, char *entry, int base)
+{
+	int (*code)(int **stack, long base, int *globals, char *entry);
+
+	code = (int (*)(int **, long, int *, char *))lc->jit_funcs[f].code;
+	return code(&lc->vm_stack, (long)base * (long)sizeof(int), lc->globals, entry);
+}
+
+/* Call function f from native code, with the n arguments at
+   args. pos is the operation making the call.
+*/
+int jit_call(int f, int *args, int n, int pos)
+{
+	struct vm_func_type *vf;
+	int base, value;
+
+	vf = &lc->pg->vm_func[f];
+	base = (int)(args - lc->vm_stack);
+	set_token(lc->pg->tok_buf + lc->pg->vm_pos[pos]); /* report a failure here */
+	if (lc->vm_fp >= lc->max_calls) sntx_err(NEST_FUNC);
+	while (base + vf->nslots + vf->depth > lc->vm_stack_size)
+		lc->vm_stack = (int *)grow_table(lc->vm_stack, &lc->vm_stack_size, sizeof(int),
+			lc->max_locals, TOO_MANY_LVARS);
+	if (n > vf->nparams) n = vf->nparams; /* drop extra arguments */
+	memset(lc->vm_stack + base + n, 0, (vf->nslots - n) * sizeof(int));
+	lc->vm_fp++;
+	COUNT(calls);
+	COUNT_MAX(max_functos, lc->vm_fp + 1); /* with main() */
+	COUNT_MAX(max_lvartos, base + vf->nslots);
+	value = vm_exec(f, base);
+	lc->vm_fp--;
+	return value;
+}
+
+/* Report an error at the operation pos. */
+void jit_error(int pos, int error)
+{
+	set_token(lc->pg->tok_buf + lc->pg->vm_pos[pos]);
+	sntx_err(error);
+}
+
+/* The library functions, as the stack machine runs them. */
+int jit_getche(void)
+{
+	COUNT(builtins);
+	return read_char();
+}
+
+int jit_getnum(void)
+{
+	COUNT(builtins);
+	return read_num();
+}
+
+void jit_putch(int c)
+{
+	COUNT(builtins);
+	out_char(c);
+}
+
+void jit_puts(int s)
+{
+	COUNT(builtins);
+	out_string(s);
+	out_char('\n');
+}
+
+void jit_prints(int s)
+{
+	COUNT(builtins);
+	out_string(s);
+	out_char(' ');
+}
+
+void jit_printn(int n)
+{
+	COUNT(builtins);
+	out_num(n);
+	out_char(' ');
+}
+
+/* Add n bytes of native code. */
+static void jit_bytes(struct jit_buf *b, const char *bytes, int n)
+{
+	while (b->len + n > b->size) {
+		b->size = b->size ? b->size * 2 : 4096;
+		if ((b->code = (unsigned char *)realloc(b->code, b->size)) == NULL) {
+			printf("Allocation Failure");
+			exit(1);
+		}
+	}
+	memcpy(b->code + b->len, bytes, n);
+	b->len += n;
+}
+
+/* Add a 32 bit value. */
+static void jit_word(struct jit_buf *b, int word)
+{
+	char bytes[4];
+
+	bytes[0] = (char)word;
+	bytes[1] = (char)(word >> 8);
+	bytes[2] = (char)(word >> 16);
+	bytes[3] = (char)(word >> 24);
+	jit_bytes(b, bytes, 4);
+}
+
+/* Add an instruction whose memory operand is disp bytes into
+   the frame, [rbx + disp], or into the globals, [r15 + disp].
+   reg is the register or opcode extension, and an opcode
+   above 0xff is two bytes long.
+*/
+static void jit_frame(struct jit_buf *b, int opcode, int reg, int disp)
+{
+	char bytes[3];
+	int n;
+
+	n = 0;
+	if (opcode > 0xff) bytes[n++] = (char)(opcode >> 8);
+	bytes[n++] = (char)opcode;
+	bytes[n++] = (char)(0x80 | reg << 3 | 3);
+	jit_bytes(b, bytes, n);
+	jit_word(b, disp);
+}
+
+static void jit_global(struct jit_buf *b, int opcode, int reg, int disp)
+{
+	char bytes[3];
+
+	bytes[0] = 0x41;
+	bytes[1] = (char)opcode;
+	bytes[2] = (char)(0x80 | reg << 3 | 7);
+	jit_bytes(b, bytes, 3);
+	jit_word(b, disp);
+}
+
+/* Add mov reg, value. */
+static void jit_movi(struct jit_buf *b, int reg, int value)
+{
+	char op;
+
+	op = (char)(0xb8 + reg);
+	jit_bytes(b, &op, 1);
+	jit_word(b, value);
+}
+
+/* Add a call of a C function, after which the frame is found
+   again, since the call may have moved vm_stack.
+*/
+static void jit_ccall(struct jit_buf *b, void (*fn)(void))
+{
+	char bytes[10];
+	unsigned long long a;
+	int i;
+
+	a = (unsigned long long)(size_t)fn;
+	bytes[0] = 0x48; /* mov rax, fn */
+	bytes[1] = (char)0xb8;
+	jit_bytes(b, bytes, 2);
+	for (i = 0; i < 8; i++) bytes[i] = (char)(a >> i * 8);
+	jit_bytes(b, bytes, 8);
+	jit_bytes(b, "\xff\xd0" "\x49\x8b\x5d\x00" "\x4c\x01\xf3", 9); /* call rax; mov rbx, [r13]; add rbx, r14 */
+}
+
+/* Add a jump to the operation at target, to be filled in
+   once the whole function has been written. opcode is the
+   one or two bytes before the 32 bit offset.
+*/
+static void jit_jump(struct jit_buf *b, const char *opcode, int n, int target)
+{
+	jit_bytes(b, opcode, n);
+	if (b->nfix == b->fix_size)
+		b->fix = (int *)grow_table(b->fix, &b->fix_size, 2 * sizeof(int), INT_MAX / 2, SYNTAX);
+	b->fix[2 * b->nfix] = b->len;
+	b->fix[2 * b->nfix + 1] = target;
+	b->nfix++;
+	jit_word(b, 0);
+}
+
+/* Compile function f to native code. Return 0 if it cannot be. */
+int jit_compile(int f)
+{
+	static const char setcc[] = { (char)0x9c, (char)0x9e, (char)0x9f, (char)0x9d, (char)0x94, (char)0x95 };
+	static const char jcc[] = { (char)0x8c, (char)0x8e, (char)0x8f, (char)0x8d, (char)0x84, (char)0x85 };
+	struct lc_program *pg;
+	struct vm_func_type *vf;
+	struct jit_func *jf;
+	struct jit_buf b;
+	int *code, *depth, *at;
+	int len, i, k, op, n, slots, ok, end;
+	char bytes[2];
+	void *mem;
+
+	pg = lc->pg;
+	vf = &pg->vm_func[f];
+	jf = &lc->jit_funcs[f];
+	code = pg->vm_code + vf->entry;
+	len = (f + 1 < pg->func_index ? pg->vm_func[f + 1].entry : pg->vm_len) - vf->entry;
+	slots = vf->nslots * (int)sizeof(int);
+
+	/* find the depth of the stack at each operation */
+	depth = (int *)malloc(len * sizeof(int));
+	at = (int *)malloc(len * sizeof(int));
+	if (depth == NULL || at == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	for (i = 0; i < len; i++) depth[i] = at[i] = -1;
+	k = 0;
+	for (i = 0; i < len; i += 1 + vm_words[op]) {
+		op = code[i];
+		if (depth[i] >= 0) k = depth[i]; /* the target of a jump */
+		depth[i] = k;
+		k += op == OP_CALL ? 1 - code[i + 2] : vm_effect[op];
+		if ((op >= OP_JMP && op <= OP_JNZ) || (op >= OP_JLT && op <= OP_JNE)) {
+			n = code[i + 1] - vf->entry;
+			if (n >= 0 && n < len) depth[n] = k;
+		}
+		if (op == OP_JMP || op == OP_RET || op == OP_TAILCALL) k = 0; /* statements start empty */
+	}
+
+	/* write the code, the prologue first */
+	memset(&b, 0, sizeof(b));
+	jit_bytes(&b, "\x55\x53\x41\x55\x41\x56\x41\x57", 8); /* push rbp, rbx, r13, r14, r15 */
+	jit_bytes(&b, "\x49\x89\xfd\x49\x89\xf6\x49\x89\xd7", 9); /* mov r13, rdi; mov r14, rsi; mov r15, rdx */
+	jit_bytes(&b, "\x49\x8b\x5d\x00\x4c\x01\xf3", 7); /* mov rbx, [r13]; add rbx, r14 */
+	jit_bytes(&b, "\xff\xe1", 2); /* jmp rcx, the entry */
+
+	ok = 1;
+	for (i = 0; i < len && ok; i += 1 + vm_words[op]) {
+		op = code[i];
+		k = slots + depth[i] * (int)sizeof(int); /* just above the top of the stack */
+		at[i] = b.len;
+		switch (op) {
+		case OP_PUSH:
+			jit_frame(&b, 0xc7, 0, k);
+			jit_word(&b, code[i + 1]);
+			break;
+		case OP_LOAD:
+			jit_frame(&b, 0x8b, 0, code[i + 1] * 4);
+			jit_frame(&b, 0x89, 0, k);
+			break;
+		case OP_STORE:
+			jit_frame(&b, 0x8b, 0, k - 4);
+			jit_frame(&b, 0x89, 0, code[i + 1] * 4);
+			break;
+		case OP_GLOAD:
+			jit_global(&b, 0x8b, 0, code[i + 1] * 4);
+			jit_frame(&b, 0x89, 0, k);
+			break;
+		case OP_GSTORE:
+			jit_frame(&b, 0x8b, 0, k - 4);
+			jit_global(&b, 0x89, 0, code[i + 1] * 4);
+			break;
+		case OP_POP:
+			break;
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MUL:
+			jit_frame(&b, 0x8b, 0, k - 8);
+			jit_frame(&b, op == OP_ADD ? 0x03 : op == OP_SUB ? 0x2b : 0x0faf, 0, k - 4);
+			jit_frame(&b, 0x89, 0, k - 8);
+			break;
+		case OP_DIV:
+		case OP_MOD:
+			jit_frame(&b, 0x8b, 1, k - 4); /* mov ecx, divisor */
+			jit_bytes(&b, "\x85\xc9\x75\x00", 4); /* test ecx, ecx; jnz over the error */
+			end = b.len;
+			jit_movi(&b, 7, i + vf->entry);
+			jit_movi(&b, 6, DIV_BY_ZERO);
+			jit_ccall(&b, (void (*)(void))jit_error);
+			b.code[end - 1] = (unsigned char)(b.len - end);
+			jit_frame(&b, 0x8b, 0, k - 8);
+			jit_bytes(&b, "\x83\xf9\xff\x75\x00", 5); /* cmp ecx, -1; jne over the error */
+			n = b.len;
+			jit_bytes(&b, "\x3d\x00\x00\x00\x80\x75\x00", 7); /* cmp eax, INT_MIN; jne over it */
+			end = b.len;
+			jit_movi(&b, 7, i + vf->entry);
+			jit_movi(&b, 6, INT_OVERFLOW);
+			jit_ccall(&b, (void (*)(void))jit_error);
+			b.code[n - 1] = (unsigned char)(b.len - n);
+			b.code[end - 1] = (unsigned char)(b.len - end);
+			jit_bytes(&b, "\x99\xf7\xf9", 3); /* cdq; idiv ecx */
+			jit_frame(&b, 0x89, op == OP_DIV ? 0 : 2, k - 8);
+			break;
+		case OP_NEG:
+			jit_frame(&b, 0xf7, 3, k - 4);
+			break;
+		case OP_LT: case OP_LE: case OP_GT:
+		case OP_GE: case OP_EQ: case OP_NE:
+			jit_frame(&b, 0x8b, 0, k - 8);
+			jit_frame(&b, 0x3b, 0, k - 4);
+			bytes[0] = 0x0f;
+			bytes[1] = setcc[op - OP_LT];
+			jit_bytes(&b, bytes, 2);
+			jit_bytes(&b, "\xc0\x0f\xb6\xc0", 4); /* al; movzx eax, al */
+			jit_frame(&b, 0x89, 0, k - 8);
+			break;
+		case OP_JMP:
+			jit_jump(&b, "\xe9", 1, code[i + 1]);
+			break;
+		case OP_JZ:
+		case OP_JNZ:
+			jit_frame(&b, 0x8b, 0, k - 4);
+			jit_bytes(&b, "\x85\xc0", 2);
+			jit_jump(&b, op == OP_JZ ? "\x0f\x84" : "\x0f\x85", 2, code[i + 1]);
+			break;
+		case OP_JLT: case OP_JLE: case OP_JGT:
+		case OP_JGE: case OP_JEQ: case OP_JNE:
+			jit_frame(&b, 0x8b, 0, k - 8);
+			jit_frame(&b, 0x3b, 0, k - 4);
+			bytes[0] = 0x0f;
+			bytes[1] = jcc[op - OP_JLT];
+			jit_jump(&b, bytes, 2, code[i + 1]);
+			break;
+		case OP_ADDSTORE:
+			jit_frame(&b, 0x8b, 0, code[i + 1] * 4);
+			jit_frame(&b, 0x03, 0, code[i + 2] * 4);
+			jit_frame(&b, 0x89, 0, code[i + 3] * 4);
+			break;
+		case OP_INC:
+			jit_frame(&b, 0x81, 0, code[i + 1] * 4);
+			jit_word(&b, code[i + 2]);
+			break;
+		case OP_GINC:
+			jit_global(&b, 0x81, 0, code[i + 1] * 4);
+			jit_word(&b, code[i + 2]);
+			break;
+		case OP_CALL:
+			n = code[i + 2];
+			jit_movi(&b, 7, code[i + 1]);
+			jit_bytes(&b, "\x48", 1);
+			jit_frame(&b, 0x8d, 6, k - n * 4); /* lea rsi, the arguments */
+			jit_movi(&b, 2, n);
+			jit_movi(&b, 1, i + vf->entry);
+			jit_ccall(&b, (void (*)(void))jit_call);
+			jit_frame(&b, 0x89, 0, k - n * 4);
+			break;
+		case OP_TAILCALL:
+			if (code[i + 1] != f) { /* only calls of the function itself are made */
+				ok = 0;
+				break;
+			}
+			n = code[i + 2] < vf->nparams ? code[i + 2] : vf->nparams;
+			for (end = 0; end < n; end++) { /* the arguments replace the parameters */
+				jit_frame(&b, 0x8b, 0, k - (code[i + 2] - end) * 4);
+				jit_frame(&b, 0x89, 0, end * 4);
+			}
+			for (; end < vf->nslots; end++) {
+				jit_frame(&b, 0xc7, 0, end * 4);
+				jit_word(&b, 0);
+			}
+			jit_jump(&b, "\xe9", 1, vf->entry);
+			break;
+		case OP_RET:
+			jit_frame(&b, 0x8b, 0, k - 4);
+			jit_bytes(&b, "\x41\x5f\x41\x5e\x41\x5d\x5b\x5d\xc3", 9); /* pop r15, r14, r13, rbx, rbp; ret */
+			break;
+		case OP_GETCHE:
+		case OP_GETNUM:
+			jit_ccall(&b, op == OP_GETCHE ? (void (*)(void))jit_getche : (void (*)(void))jit_getnum);
+			jit_frame(&b, 0x89, 0, k);
+			break;
+		case OP_PUTCH:
+			jit_frame(&b, 0x8b, 7, k - 4);
+			jit_ccall(&b, (void (*)(void))jit_putch);
+			break;
+		case OP_PUTS:
+		case OP_PRINTS:
+			jit_movi(&b, 7, code[i + 1]);
+			jit_ccall(&b, op == OP_PUTS ? (void (*)(void))jit_puts : (void (*)(void))jit_prints);
+			jit_frame(&b, 0xc7, 0, k);
+			jit_word(&b, 0);
+			break;
+		case OP_PRINTN:
+			jit_frame(&b, 0x8b, 7, k - 4);
+			jit_ccall(&b, (void (*)(void))jit_printn);
+			jit_frame(&b, 0xc7, 0, k - 4);
+			jit_word(&b, 0);
+			break;
+		case OP_END:
+			jit_movi(&b, 7, 0);
+			jit_ccall(&b, (void (*)(void))stop_program);
+			break;
+		case OP_ERR:
+			jit_movi(&b, 7, i + vf->entry);
+			jit_movi(&b, 6, code[i + 1]);
+			jit_ccall(&b, (void (*)(void))jit_error);
+			break;
+		default:
+			ok = 0;
+		}
+	}
+
+	/* point the jumps at their targets */
+	end = b.len;
+	for (i = 0; i < b.nfix && ok; i++) {
+		n = b.fix[2 * i + 1] - vf->entry;
+		if (n < 0 || n >= len || at[n] < 0) ok = 0;
+		else {
+			b.len = b.fix[2 * i];
+			jit_word(&b, at[n] - (b.len + 4));
+		}
+	}
+	b.len = end;
+	free(b.fix);
+
+	mem = MAP_FAILED;
+	if (ok) { /* copy the code where it can be run */
+		jf->size = (size_t)b.len;
+		mem = mmap(NULL, jf->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem != MAP_FAILED) {
+			memcpy(mem, b.code, b.len);
+			if (mprotect(mem, jf->size, PROT_READ | PROT_EXEC) != 0) {
+				munmap(mem, jf->size);
+				mem = MAP_FAILED;
+			}
+		}
+	}
+	free(b.code);
+	if (mem == MAP_FAILED) {
+		free(depth);
+		free(at);
+		return 0;
+	}
+	for (i = 0; i < len; i++) /* loops can be entered where the stack is empty */
+		if (at[i] >= 0 && depth[i] != 0) at[i] = -1;
+	free(depth);
+	jf->code = (char *)mem;
+	jf->entry = at;
+	lc->jit_compiled++;
+	return 1;
+}
+
+#else
+
+void jit_start(void) { } /* --jit is not available */
+void jit_stop(void) { }
+
+#endif
+
+/****** Program Cache *******/
+
+/* With --cache-dir, a prepared program is saved in a file named
+   for a hash of its source, and the next time the same source
+   is run its tables are taken from the file instead of lexing
+   and compiling it again. Where it can be, the file is mapped
+   into memory and the tables are used where they lie; only the
+   ones holding pointers into the tokens are rebuilt. A cache
+   file is trusted only if it was written by the same version
+   of the cache, with the same engine, for exactly the same
+   source, which it keeps a copy of.
+*/
+
+#define CACHE_VERSION '6' /* change whenever what is saved changes */
+
+struct cache_header {
+	char magic[4];               /* "LCC" and CACHE_VERSION */
+	int int_size, rec_size;      /* sizes of an int and a token_rec */
+	int engine, opt;             /* how the program was prepared */
+	int p_len, tok_count, t_len; /* sizes of the tables that follow */
+	int id_count, id_hash_size, str_count;
+	int func_index, gvar_index, loop_count;
+	int main_func, vm_funcs, vm_len;
+};
+
+#define CACHE_ALIGN(n) (((n) + 7) & ~7L) /* each table starts on 8 bytes */
+
+/* Return the name of the cache file for the program, which
+   the caller must free.
+*/
+static char *cache_name(void)
+{
+	unsigned long h;
+	char *name, *p;
+	int i;
+
+	h = 2166136261UL; /* FNV-1a hash of the source and engine */
+	for (i = 0; i < lc->pg->p_len; i++)
+		h = ((h ^ (unsigned char)lc->pg->p_buf[i]) * 16777619UL) & 0xffffffffUL;
+	h = ((h ^ (unsigned)lc->engine) * 16777619UL) & 0xffffffffUL;
+	h = ((h ^ (unsigned)lc->opt) * 16777619UL) & 0xffffffffUL;
+
+	name = (char *)malloc(strlen(lc->cache_dir) + 16);
+	if (name == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	p = name + strlen(strcpy(name, lc->cache_dir));
+	sprintf(p, "/%08lx.lcc", h);
+	return name;
+}
+
+/* Map the cache file name into memory, or read it, and return
+   where it is, or NULL if there is none.
+*/
+static char *read_cache(char *name, long *len)
+{
+	char *data;
+#ifdef LC_MMAP
+	struct stat st;
+	int fd;
+
+	if ((fd = open(name, O_RDONLY)) < 0) return NULL;
+	data = NULL;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		*len = (long)st.st_size;
+		data = (char *)mmap(NULL, (size_t)*len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == (char *)MAP_FAILED) data = NULL;
+	}
+	close(fd);
+#else
+	FILE *fp;
+
+	if (fopen_s(&fp, name, "rb") != 0 || fp == NULL) return NULL;
+	data = NULL;
+	if (fseek(fp, 0, SEEK_END) == 0 && (*len = ftell(fp)) > 0) {
+		rewind(fp);
+		if ((data = (char *)malloc(*len)) == NULL) {
+			printf("Allocation Failure");
+			exit(1);
+		}
+		if (fread(data, 1, *len, fp) != (size_t)*len) {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(fp);
+#endif
+	return data;
+}
+
+/* Release the cache file a program's tables are in. */
+void free_cache(struct lc_program *pg)
+{
+#ifdef LC_MMAP
+	munmap(pg->cache, (size_t)pg->cache_len);
+#else
+	free(pg->cache);
+#endif
+}
+
+/* Return the next table of n bytes in the cache file, or NULL
+   if the file is too short to hold it.
+*/
+static char *cache_table(char **p, char *end, long n)
+{
+	char *table;
+
+	if (n < 0 || end - *p < n) return NULL;
+	table = *p;
+	*p += CACHE_ALIGN(n);
+	if (*p > end) *p = end;
+	return table;
+}
+
+#define CACHE_BAD(i, n) ((unsigned)(i) >= (unsigned)(n)) /* an index out of 0 to n - 1 */
+
+/* Return true if the tables taken from the cache, in pg, and
+   the functions in funcs, whose tokens are at the offsets in
+   locs, and the loops, whose tokens are at the offsets in
+   loops, only refer to what is there and keep to the limits.
+   A file that was damaged, or written by something else,
+   could otherwise make the interpreter read or jump anywhere.
+*/
+static int cache_valid(struct cache_header *h, struct func_type *funcs, int *locs, int *loops)
+{
+	struct lc_program *pg;
+	struct token_rec *t, *end;
+	struct func_type *ft;
+	struct vm_func_type *vf;
+	char c;
+	int i, k, n, f, op, last, stop, *code, *depth;
+
+	pg = lc->pg;
+	if (h->tok_count < 1 || h->t_len < 1 || pg->t_pool[h->t_len - 1] ||
+		h->id_count < 0 || h->str_count < 0 || h->func_index < 0 || h->loop_count < 0 ||
+		h->id_hash_size <= h->id_count || h->id_hash_size & (h->id_hash_size - 1) ||
+		CACHE_BAD(h->main_func, h->func_index) || h->vm_len < 0 ||
+		h->vm_funcs != (lc->engine == VM_ENGINE ? h->func_index + 1 : 0))
+		return 0;
+
+	/* the tokens */
+	if (pg->tok_buf[h->tok_count - 1].tok != FINISHED) return 0;
+	for (i = 0; i < h->tok_count; i++) {
+		t = &pg->tok_buf[i];
+		if (CACHE_BAD(t->text, h->t_len) || CACHE_BAD(t->offset, h->p_len + 1) ||
+			(t->id != -1 && CACHE_BAD(t->id, h->id_count)) || t->skip < 0 ||
+			(i + 1 < h->tok_count && CACHE_BAD(i + 1 + t->skip, h->tok_count)))
+			return 0;
+		c = pg->t_pool[t->text];
+		switch (t->token_type) {
+		case IDENTIFIER:
+			if (t->id < 0) return 0;
+			if ((t->bind == BIND_LOCAL && CACHE_BAD(t->value, lc->max_locals)) ||
+				(t->bind == BIND_GLOBAL && CACHE_BAD(t->value, h->gvar_index)) ||
+				(t->bind == BIND_FUNC && CACHE_BAD(t->value, h->func_index)) ||
+				(t->bind == BIND_BUILTIN && CACHE_BAD(t->value, LIB_GETNUM + 1)))
+				return 0;
+			break;
+		case STRING:
+			if (CACHE_BAD(t->value, h->str_count)) return 0;
+			break;
+		case DELIMITER: case BLOCK: /* the index of the matching parenthesis or brace */
+			if ((c == '(' || c == ')' || c == '{' || c == '}') && CACHE_BAD(t->value, h->tok_count))
+				return 0;
+			break;
+		}
+	}
+
+	/* the names, strings and globals */
+	for (i = 0; i < h->id_count; i++)
+		if (CACHE_BAD(pg->id_text[i], h->t_len) ||
+			(pg->sym_table[i].func != -1 && CACHE_BAD(pg->sym_table[i].func, h->func_index)) ||
+			(pg->sym_table[i].builtin != -1 && CACHE_BAD(pg->sym_table[i].builtin, LIB_GETNUM + 1)) ||
+			(pg->sym_table[i].global != -1 && CACHE_BAD(pg->sym_table[i].global, h->gvar_index)))
+			return 0;
+	for (i = 0; i < h->id_hash_size; i++)
+		if (CACHE_BAD(pg->id_hash[i], h->id_count + 1)) return 0;
+	for (i = 0; i < h->str_count; i++)
+		if (CACHE_BAD(pg->str_table[i].text, h->t_len) || pg->str_table[i].len < 0 ||
+			pg->str_table[i].len > h->t_len - pg->str_table[i].text)
+			return 0;
+	for (i = 0; i < h->gvar_index; i++)
+		if (CACHE_BAD(pg->global_vars[i].id, h->id_count)) return 0;
+
+	/* the loops */
+	for (i = 0; i < 4 * h->loop_count; i++)
+		if (CACHE_BAD(loops[i], h->tok_count) && !(i % 4 == 1 && loops[i] == -1)) return 0;
+
+	/* the functions, whose locals must be in their frames */
+	for (f = 0; f < h->func_index; f++) {
+		ft = &funcs[f];
+		if (CACHE_BAD(locs[f] - 1, h->tok_count - 1) || !memchr(ft->func_name, '\0', ID_LEN) ||
+			ft->nparams < 0 || ft->nparams > ft->nslots || ft->nslots > lc->max_locals)
+			return 0;
+		i = pg->tok_buf[locs[f] - 1].value + 1; /* the body */
+		if (CACHE_BAD(i, h->tok_count) || pg->tok_buf[i].token_type != BLOCK ||
+			pg->tok_buf[i].value < i)
+			return 0;
+		end = pg->tok_buf + pg->tok_buf[i].value;
+		for (t = pg->tok_buf + locs[f]; t < end; t++)
+			if ((t->token_type == IDENTIFIER && t->bind == BIND_LOCAL && t->value >= ft->nslots) ||
+				(t->token_type == KEYWORD && (t->tok == FOR || t->tok == WHILE || t->tok == DO) &&
+				CACHE_BAD(t->value, h->loop_count)) ||
+				(t->token_type == KEYWORD && t->tok == RETURN && t->value && /* return f(...); in f */
+				(t[1].token_type != IDENTIFIER || t[1].bind != BIND_FUNC || t[1].value != f)))
+				return 0;
+	}
+
+	/* the compiled code, which must be whole operations that only
+	   use their own function's frame and jump within it, leaving
+	   the stack as deep at each jump as where it lands */
+	if (!h->vm_funcs) return h->vm_len == 0;
+	for (i = 0; i < h->vm_len; i++)
+		if (CACHE_BAD(pg->vm_pos[i], h->tok_count)) return 0;
+	depth = (int *)malloc((h->vm_len + 1) * sizeof(int));
+	if (depth == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	code = pg->vm_code;
+	stop = 0;
+	for (f = 0; f < h->func_index; f++) {
+		vf = &pg->vm_func[f];
+		if (vf->entry != stop) break; /* each follows the one before */
+		stop = f + 1 < h->func_index ? pg->vm_func[f + 1].entry : h->vm_len;
+		if (vf->entry >= stop || stop > h->vm_len || vf->nparams != funcs[f].nparams || vf->nslots != funcs[f].nslots ||
+			vf->depth < 0 || vf->depth > lc->max_locals)
+			break;
+		last = -1;
+		for (i = vf->entry; i < stop; i++) depth[i] = -2; /* not an operation */
+		for (i = vf->entry; i < stop; i += 1 + vm_words[op]) {
+			op = code[i];
+			if (CACHE_BAD(op, OP_ERR + 1) || i + vm_words[op] >= stop) break;
+			depth[i] = -1; /* an operation, not reached yet */
+			last = op;
+		}
+		if (i != stop || last != OP_RET) break;
+
+		k = 0;
+		last = -1;
+		for (i = vf->entry; i < stop; i += 1 + vm_words[op]) {
+			if (last == OP_JMP || last == OP_RET || last == OP_TAILCALL || last == OP_END)
+				k = depth[i] < 0 ? 0 : depth[i]; /* statements start empty */
+			else if (depth[i] >= 0 && depth[i] != k) break;
+			depth[i] = k;
+			op = last = code[i];
+			n = op == OP_CALL || op == OP_TAILCALL ? code[i + 2] : vm_uses[op];
+			if (n < 0 || k < n) break; /* it would use values not there */
+			k += op == OP_CALL ? 1 - n : vm_effect[op];
+			if (k > vf->depth) break;
+			if (((op == OP_LOAD || op == OP_STORE || op == OP_INC) && CACHE_BAD(code[i + 1], vf->nslots)) ||
+				(op == OP_ADDSTORE && (CACHE_BAD(code[i + 1], vf->nslots) ||
+				CACHE_BAD(code[i + 2], vf->nslots) || CACHE_BAD(code[i + 3], vf->nslots))) ||
+				((op == OP_GLOAD || op == OP_GSTORE || op == OP_GINC) && CACHE_BAD(code[i + 1], h->gvar_index)) ||
+				(op == OP_CALL && CACHE_BAD(code[i + 1], h->func_index)) ||
+				(op == OP_TAILCALL && code[i + 1] != f) || /* only a function calls itself so */
+				((op == OP_PUTS || op == OP_PRINTS) && CACHE_BAD(code[i + 1], h->str_count)) ||
+				(op == OP_ERR && CACHE_BAD(code[i + 1], TOO_MANY_GVARS + 1)))
+				break;
+			if ((op >= OP_JMP && op <= OP_JNZ) || (op >= OP_JLT && op <= OP_JNE)) {
+				n = code[i + 1];
+				if (CACHE_BAD(n - vf->entry, stop - vf->entry) || depth[n] == -2 ||
+					(depth[n] >= 0 && depth[n] != k))
+					break;
+				depth[n] = k;
+			}
+		}
+		if (i != stop) break;
+	}
+	free(depth);
+	return f == h->func_index && stop == h->vm_len;
+}
+
+/* Take the prepared program from the cache, if it is there.
+   Return 0 if it has to be prepared from its source.
+*/
+int load_cache(void)
+{
+	struct lc_program *pg, saved;
+	struct cache_header h;
+	char *name, *data, *p, *end, *src, *toks, *pool, *ids, *hash;
+	char *strs, *syms, *funcs, *locs, *gvars, *loops, *vmf, *code, *pos;
+	long len;
+	int i, *ip;
+
+	pg = lc->pg;
+	name = cache_name();
+	data = read_cache(name, &len);
+	free(name);
+	if (data == NULL) return 0;
+	p = data;
+	end = data + len;
+
+	if (len < (long)sizeof(h)) goto miss;
+	memcpy(&h, data, sizeof(h));
+	p += CACHE_ALIGN((long)sizeof(h));
+	if (memcmp(h.magic, "LCC", 3) || h.magic[3] != CACHE_VERSION ||
+		h.int_size != (int)sizeof(int) || h.rec_size != (int)sizeof(struct token_rec) ||
+		h.engine != lc->engine || h.opt != lc->opt || h.p_len != pg->p_len ||
+		h.gvar_index > lc->max_globals) /* let prepare report it */
+		goto miss;
+
+	src = cache_table(&p, end, h.p_len);
+	if (src == NULL || memcmp(src, pg->p_buf, pg->p_len)) goto miss;
+	toks = cache_table(&p, end, (long)h.tok_count * sizeof(struct token_rec));
+	pool = cache_table(&p, end, h.t_len);
+	ids = cache_table(&p, end, (long)h.id_count * sizeof(int));
+	hash = cache_table(&p, end, (long)h.id_hash_size * sizeof(int));
+	strs = cache_table(&p, end, (long)h.str_count * sizeof(struct str_type));
+	syms = cache_table(&p, end, (long)h.id_count * sizeof(struct sym_type));
+	funcs = cache_table(&p, end, (long)h.func_index * sizeof(struct func_type));
+	locs = cache_table(&p, end, (long)h.func_index * sizeof(int));
+	gvars = cache_table(&p, end, (long)h.gvar_index * sizeof(struct var_type));
+	loops = cache_table(&p, end, (long)h.loop_count * 4 * sizeof(int));
+	vmf = cache_table(&p, end, (long)h.vm_funcs * sizeof(struct vm_func_type));
+	code = cache_table(&p, end, (long)h.vm_len * sizeof(int));
+	pos = cache_table(&p, end, (long)h.vm_len * sizeof(int));
+	if (!toks || !pool || !ids || !hash || !strs || !syms || !funcs || !locs ||
+		!gvars || !loops || !vmf || !code || !pos)
+		goto miss;
+
+	/* the tables without pointers are used where they lie */
+	saved = *pg;
+	pg->cache = data;
+	pg->cache_len = len;
+	pg->tok_buf = (struct token_rec *)toks;
+	pg->tok_count = pg->tok_size = h.tok_count;
+	pg->t_pool = pool;
+	pg->t_len = pg->t_size = h.t_len;
+	pg->id_text = (int *)ids;
+	pg->id_count = h.id_count;
+	pg->id_hash = (int *)hash;
+	pg->id_hash_size = h.id_hash_size;
+	pg->str_table = (struct str_type *)strs;
+	pg->str_count = pg->str_size = h.str_count;
+	pg->sym_table = (struct sym_type *)syms;
+	pg->global_vars = (struct var_type *)gvars;
+	pg->gvar_index = pg->gvar_size = h.gvar_index;
+	pg->vm_func = h.vm_funcs ? (struct vm_func_type *)vmf : NULL;
+	pg->vm_code = (int *)code;
+	pg->vm_pos = (int *)pos;
+	pg->vm_len = pg->vm_size = h.vm_len;
+	pg->main_func = h.main_func;
+	if (!cache_valid(&h, (struct func_type *)funcs, (int *)locs, (int *)loops)) {
+		*pg = saved; /* prepare it from its source instead */
+		goto miss;
+	}
+
+	/* the others point to tokens, so they are rebuilt */
+	pg->func_table = (struct func_type *)malloc((h.func_index + 1) * sizeof(struct func_type));
+	pg->loop_table = (struct loop_type *)malloc((h.loop_count + 1) * sizeof(struct loop_type));
+	if (pg->func_table == NULL || pg->loop_table == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	memcpy(pg->func_table, funcs, h.func_index * sizeof(struct func_type));
+	pg->func_index = pg->func_size = h.func_index;
+	ip = (int *)locs;
+	for (i = 0; i < h.func_index; i++) {
+		pg->func_table[i].loc = pg->tok_buf + ip[i];
+		pg->func_table[i].body = pg->tok_buf + pg->func_table[i].loc[-1].value + 1;
+	}
+	ip = (int *)loops;
+	for (i = 0; i < h.loop_count; i++, ip += 4) {
+		pg->loop_table[i].cond = pg->tok_buf + ip[0];
+		pg->loop_table[i].incr = ip[1] < 0 ? NULL : pg->tok_buf + ip[1];
+		pg->loop_table[i].body = pg->tok_buf + ip[2];
+		pg->loop_table[i].exit = pg->tok_buf + ip[3];
+	}
+	pg->loop_count = pg->loop_size = h.loop_count;
+	return 1;
+
+miss:
+	pg->cache = data;
+	pg->cache_len = len;
+	free_cache(pg);
+	pg->cache = NULL;
+	return 0;
+}
+
+/* Write n bytes of a table to the cache file, padded to the
+   start of the next one.
+*/
+static void cache_put(FILE *fp, void *table, long n)
+{
+	static char pad[8];
+
+	if (n > 0) fwrite(table, 1, n, fp);
+	fwrite(pad, 1, CACHE_ALIGN(n) - n, fp);
+}
+
+/* Save the prepared program in the cache. Failing to is not
+   an error; the program is just prepared again next time.
+*/
+void store_cache(void)
+{
+	struct lc_program *pg;
+	struct cache_header h;
+	char *name, *temp;
+	FILE *fp;
+	int i, *locs, loop[4];
+
+	pg = lc->pg;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "LCC", 3);
+	h.magic[3] = CACHE_VERSION;
+	h.int_size = (int)sizeof(int);
+	h.rec_size = (int)sizeof(struct token_rec);
+	h.engine = lc->engine;
+	h.opt = lc->opt;
+	h.p_len = pg->p_len;
+	h.tok_count = pg->tok_count;
+	h.t_len = pg->t_len;
+	h.id_count = pg->id_count;
+	h.id_hash_size = pg->id_hash_size;
+	h.str_count = pg->str_count;
+	h.func_index = pg->func_index;
+	h.gvar_index = pg->gvar_index;
+	h.loop_count = pg->loop_count;
+	h.main_func = pg->main_func;
+	h.vm_funcs = pg->vm_func ? pg->func_index + 1 : 0;
+	h.vm_len = pg->vm_len;
+
+	/* write to a file of our own, then put it in place in one step,
+	   so a program run at the same time never sees half of it */
+	name = cache_name();
+	temp = (char *)malloc(strlen(name) + 32);
+	if (temp == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+#ifdef LC_MMAP
+	sprintf(temp, "%s.%ld.%p", name, (long)getpid(), (void *)pg);
+#else
+	sprintf(temp, "%s.%p", name, (void *)pg);
+#endif
+	if (fopen_s(&fp, temp, "wb") != 0 || fp == NULL) {
+		free(temp);
+		free(name);
+		return;
+	}
+	cache_put(fp, &h, sizeof(h));
+	cache_put(fp, pg->p_buf, pg->p_len);
+	cache_put(fp, pg->tok_buf, (long)pg->tok_count * sizeof(struct token_rec));
+	cache_put(fp, pg->t_pool, pg->t_len);
+	cache_put(fp, pg->id_text, (long)pg->id_count * sizeof(int));
+	cache_put(fp, pg->id_hash, (long)pg->id_hash_size * sizeof(int));
+	cache_put(fp, pg->str_table, (long)pg->str_count * sizeof(struct str_type));
+	cache_put(fp, pg->sym_table, (long)pg->id_count * sizeof(struct sym_type));
+	cache_put(fp, pg->func_table, (long)pg->func_index * sizeof(struct func_type));
+	locs = (int *)malloc((pg->func_index + 1) * sizeof(int));
+	if (locs == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	for (i = 0; i < pg->func_index; i++)
+		locs[i] = (int)(pg->func_table[i].loc - pg->tok_buf);
+	cache_put(fp, locs, (long)pg->func_index * sizeof(int));
+	free(locs);
+	cache_put(fp, pg->global_vars, (long)pg->gvar_index * sizeof(struct var_type));
+	for (i = 0; i < pg->loop_count; i++) {
+		loop[0] = (int)(pg->loop_table[i].cond - pg->tok_buf);
+		loop[1] = pg->loop_table[i].incr ? (int)(pg->loop_table[i].incr - pg->tok_buf) : -1;
+		loop[2] = (int)(pg->loop_table[i].body - pg->tok_buf);
+		loop[3] = (int)(pg->loop_table[i].exit - pg->tok_buf);
+		cache_put(fp, loop, sizeof(loop));
+	}
+	cache_put(fp, pg->vm_func, (long)h.vm_funcs * sizeof(struct vm_func_type));
+	cache_put(fp, pg->vm_code, (long)pg->vm_len * sizeof(int));
+	cache_put(fp, pg->vm_pos, (long)pg->vm_len * sizeof(int));
+
+	if (fclose(fp) != 0 || rename(temp, name) != 0) remove(temp);
+	free(temp);
+	free(name);
+}
+
+/****** Batch Runner *******/
+
+/* With --batch, each line of the jobs file names a program to
+   run, optionally followed by a file to take its input from,
+   or - for none, and a file to write its output to. Jobs are
+   shared out among a number of workers, each with its own
+   interpreter, which run in parallel where threads are
+   available. A job's output, when it has no file of its own,
+   is written to stdout as a whole when the job finishes.
+*/
+
+struct batch_job {
+	char *fname;    /* the program */
+	char *in_name;  /* file to read input from, or NULL */
+	char *out_name; /* file to write output to, or NULL */
+	int status;     /* exit status of the job */
+};
+
+struct batch_job *batch_jobs;
+int batch_count, batch_size;
+int batch_next; /* next job to be taken by a worker */
+struct lc_interp *batch_opts; /* options every worker starts with */
+
+#ifdef LC_THREADS
+pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+#define lock_batch() pthread_mutex_lock(&batch_lock)
+#define unlock_batch() pthread_mutex_unlock(&batch_lock)
+#else
+#define lock_batch()
+#define unlock_batch()
+#endif
+
+char *copy_string(char *s);
+int read_jobs(char *jobs_name);
+void *batch_worker(void *arg);
+void run_job(struct batch_job *job);
+
+/* Run every job listed in the file jobs_name with the given
+   number of workers. Return 0 if they all succeeded.
+*/
+int run_batch(char *jobs_name, int workers)
+{
+	int i, failed;
+#ifdef LC_THREADS
+	pthread_t *threads;
+#endif
+
+	if (!read_jobs(jobs_name)) {
+		fprintf(stderr, "cannot read jobs from %s\n", jobs_name);
+		return 1;
+	}
+	batch_opts = lc;
+	batch_next = 0;
+	if (workers > batch_count) workers = batch_count;
+
+#ifdef LC_THREADS
+	threads = (pthread_t *)malloc((workers + 1) * sizeof(pthread_t));
+	if (threads == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	for (i = 1; i < workers; i++) /* this thread is the first worker */
+		if (pthread_create(&threads[i], NULL, batch_worker, NULL) != 0) break;
+	workers = i;
+	batch_worker(NULL);
+	for (i = 1; i < workers; i++) pthread_join(threads[i], NULL);
+	free(threads);
+#else
+	batch_worker(NULL); /* one worker does every job */
+#endif
+
+	failed = 0;
+	for (i = 0; i < batch_count; i++) {
+		if (batch_jobs[i].status) failed++;
+		free(batch_jobs[i].fname);
+		free(batch_jobs[i].in_name);
+		free(batch_jobs[i].out_name);
+	}
+	free(batch_jobs);
+	return failed != 0;
+}
+
+/* Read the list of jobs. Return 0 if the file cannot be read. */
+int read_jobs(char *jobs_name)
+{
+	FILE *fp;
+	char line[1024], *name[3];
+	int n;
+
+	if (fopen_s(&fp, jobs_name, "r") != 0 || fp == NULL) return 0;
+	batch_count = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		n = 0;
+		name[0] = strtok(line, " \t\r\n");
+		if (name[0] == NULL || *name[0] == '#') continue; /* blank or comment */
+		while (++n < 3 && (name[n] = strtok(NULL, " \t\r\n")) != NULL);
+		while (n < 3) name[n++] = NULL;
+		if (name[1] && !strcmp(name[1], "-")) name[1] = NULL; /* no input */
+
+		if (batch_count == batch_size)
+			batch_jobs = (struct batch_job *)grow_table(batch_jobs, &batch_size,
+				sizeof(struct batch_job), INT_MAX, SYNTAX);
+		batch_jobs[batch_count].fname = copy_string(name[0]);
+		batch_jobs[batch_count].in_name = copy_string(name[1]);
+		batch_jobs[batch_count].out_name = copy_string(name[2]);
+		batch_jobs[batch_count].status = 0;
+		batch_count++;
+	}
+	fclose(fp);
+	return 1;
+}
+
+/* Return a copy of s, or NULL if s is NULL. */
+char *copy_string(char *s)
+{
+	char *p;
+
+	if (s == NULL) return NULL;
+	if ((p = (char *)malloc(strlen(s) + 1)) == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	strcpy(p, s);
+	return p;
+}
+
+/* Take jobs and run them until there are none left. */
+void *batch_worker(void *arg)
+{
+	struct lc_interp interp;
+	struct batch_job *job;
+
+	(void)arg;
+	interp = *batch_opts; /* nothing has been allocated in it yet */
+	lc = &interp;
+	for (;;) {
+		lock_batch();
+		job = batch_next < batch_count ? &batch_jobs[batch_next++] : NULL;
+		unlock_batch();
+		if (job == NULL) break;
+		run_job(job);
+	}
+	free_interp(&interp);
+	return NULL;
+}
+
+/* Run a single job, setting its exit status. */
+void run_job(struct batch_job *job)
+{
+	struct lc_program *pg;
+	char buf[4096];
+	size_t n;
+
+	job->status = 1;
+	lc->in = NULL;
+	if (job->in_name && fopen_s(&lc->in, job->in_name, "rb") != 0) lc->in = NULL;
+	if (job->out_name) {
+		if (fopen_s(&lc->out, job->out_name, "w") != 0) lc->out = NULL;
+	}
+	else lc->out = tmpfile(); /* collect the output */
+
+	if (lc->out == NULL || (job->in_name && lc->in == NULL))
+		fprintf(stderr, "%s: cannot open %s\n", job->fname,
+			lc->out == NULL ? (job->out_name ? job->out_name : "a temporary file") : job->in_name);
+	else if ((pg = prepare_program(job->fname, NULL)) != NULL) {
+		job->status = run_program(pg);
+		free_program(pg);
+	}
+
+	if (lc->in) fclose(lc->in);
+	if (lc->out && !job->out_name) { /* copy the collected output */
+		rewind(lc->out);
+		lock_batch();
+		while ((n = fread(buf, 1, sizeof(buf), lc->out)) > 0) fwrite(buf, 1, n, stdout);
+		fflush(stdout);
+		unlock_batch();
+	}
+	if (lc->out) fclose(lc->out);
+	if (job->status) {
+		lock_batch();
+		fprintf(stderr, "%s: exit status %d\n", job->fname, job->status);
+		unlock_batch();
 	}
 }
@@ -0,0 +1,325 @@
+/* Declarations shared by the modules of the Little C interpreter. */
+
+#ifndef LITTLEC_H
+#define LITTLEC_H
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "lcapi.h"
+
+/* The tables of variables and calls grow as they fill, up
+   to these limits, which can be changed from the command line.
+*/
+#define NUM_GLOBAL_VARS 100000  /* --max-globals */
+#define NUM_LOCAL_VARS  1000000 /* --max-locals */
+#define FUNC_CALLS      5000    /* --max-calls */
+
+#define OUT_BUFFER      8192    /* --output-buffer */
+
+#define NUM_BLOCK       100
+#define ID_LEN          32
+#define LOOP_NEST       31
+#define LC_PAD          32      /* zero bytes that end a source buffer,
+                                   for the lexer to read a vector past */
+
+// Secure function compatibility
+#if !defined(_MSC_VER) || _MSC_VER < 1400
+#define strcpy_s(dest, count, source) strncpy( (dest), (source), (count) )
+#define fopen_s(pFile,filename,mode) (((*(pFile))=fopen((filename),(mode)))==NULL)
+#endif
+
+enum tok_types {
+	DELIMITER, IDENTIFIER, NUMBER, KEYWORD,
+	TEMP, STRING, BLOCK
+};
+
+/* add additional C keyword tokens here */
+enum tokens {
+	ARG, CHAR, INT, IF, ELSE, FOR, DO, WHILE,
+	SWITCH, RETURN, CONTINUE, BREAK, EOL, FINISHED, END
+};
+
+/* the library functions, in the order of intern_func[] */
+enum lib_funcs { LIB_GETCHE, LIB_PUTCH, LIB_PUTS, LIB_PRINT, LIB_GETNUM };
+
+/* what an identifier has been bound to */
+enum binds { BIND_NONE, BIND_LOCAL, BIND_GLOBAL, BIND_FUNC, BIND_BUILTIN };
+
+/* add additional double operators here (such as ->) */
+enum double_ops { LT = 1, LE, GT, GE, EQ, NE };
+
+/* These are the constants used to call sntx_err() when
+   a syntax error occurs. Add more if you like.
+   NOTE: SYNTAX is a generic error message used when
+   nothing else seems appropriate.
+*/
+enum error_msg
+{
+	SYNTAX, UNBAL_PARENS, NO_EXP, EQUALS_EXPECTED,
+	NOT_VAR, PARAM_ERR, SEMI_EXPECTED,
+	UNBAL_BRACES, FUNC_UNDEF, TYPE_EXPECTED,
+	NEST_FUNC, RET_NOCALL, PAREN_EXPECTED,
+	WHILE_EXPECTED, QUOTE_EXPECTED, NOT_STRING,
+	TOO_MANY_LVARS, DIV_BY_ZERO, INT_OVERFLOW, TOO_MANY_GVARS
+};
+
+/* The program is lexed once, after it is loaded, into an
+   array of these records. The interpreter walks the array
+   instead of rescanning the source text.
+*/
+struct token_rec {
+	char token_type; /* contains type of token */
+	char tok;        /* internal representation of token */
+	char bind;       /* what an identifier is bound to */
+	int id;          /* interned identifier, or -1 */
+	int value;       /* value of a numeric or character constant,
+					    the index in str_table of a string, the
+					    slot or index of a variable, the index
+					    of the function called, the index of the
+					    matching parenthesis or brace, the loop
+					    started by a for, while or do, or for a
+					    return, 1 if it is a tail call */
+	int text;        /* offset of the token's text in t_pool,
+					    shared by the tokens spelled the same */
+	int offset;      /* offset of the token in the source */
+	int line;        /* source line the token is on */
+	int skip;        /* tokens after this one that the optimizer
+					    has folded into it, which are passed over */
+};
+
+/* Each string constant is decoded once, when the program
+   is lexed, and described by one of these.
+*/
+struct str_type {
+	int text; /* offset of the decoded string in t_pool */
+	int len;  /* its length */
+};
+
+/* An array of these structures will hold the info
+   associated with global variables.
+*/
+struct var_type {
+	int id; /* interned name */
+	int v_type;
+	int value;
+};
+
+struct func_type {
+	char func_name[ID_LEN];
+	int ret_type;
+	struct token_rec *loc;  /* location of entry point in file */
+	struct token_rec *body; /* opening brace of the function's body */
+	int nparams;            /* number of parameters */
+	int nslots;             /* parameters plus local variables, the
+							   size of the function's frame */
+};
+
+/* Each loop in the program is described once, when the
+   program is loaded, by one of these.
+*/
+struct loop_type {
+	struct token_rec *cond; /* start of the loop condition */
+	struct token_rec *incr; /* increment of a for, or NULL */
+	struct token_rec *body; /* opening brace of the body */
+	struct token_rec *exit; /* first token after the loop */
+};
+
+/* The symbol table has one of these for each identifier,
+   indexed by the identifier's number.
+*/
+struct sym_type {
+	int func;    /* index in func_table, or -1 */
+	int builtin; /* index in intern_func, or -1 */
+	int global;  /* index in global_vars, or -1 */
+};
+
+struct commands { /* keyword lookup table */
+	char command[20];
+	char tok;
+};
+
+/* A program that has been loaded and prepared to run.
+   Nothing in it changes while it runs, so one program can
+   be run by several interpreters at once.
+*/
+struct lc_program {
+	char *p_buf;                  /* points to start of program buffer */
+	int p_len;                    /* length of the program */
+
+	struct token_rec *tok_buf;    /* the lexed program */
+	int tok_count, tok_size;      /* tokens used and allocated */
+	char *t_pool;                 /* text of every token */
+	int t_len, t_size;            /* bytes used and allocated */
+	int *id_text;                 /* offset in t_pool of each interned text */
+	char *id_tok;                 /* keyword each text is, or 0, while lexing */
+	int id_count;                 /* number of interned identifiers */
+	int *id_hash;                 /* hash table of identifier numbers + 1 */
+	int id_hash_size;             /* number of slots in id_hash, a power of 2 */
+	struct str_type *str_table;   /* every string constant */
+	int str_count, str_size;      /* strings used and allocated */
+
+	struct sym_type *sym_table;   /* what each identifier names */
+	struct func_type *func_table;
+	int func_index, func_size;    /* functions defined and allocated */
+	struct var_type *global_vars; /* names and types of the globals */
+	int gvar_index, gvar_size;    /* globals declared and allocated */
+	struct loop_type *loop_table; /* every loop in the program */
+	int loop_count, loop_size;
+	int main_func;                /* index of main() in func_table */
+
+	struct vm_func_type *vm_func; /* compiled code, with --engine=vm */
+	int *vm_code;                 /* code of every function */
+	int *vm_pos;                  /* token each word of code came from */
+	int vm_len, vm_size;          /* words of code used and allocated */
+
+	char *cache;                  /* cache file the tables are in, or NULL */
+	long cache_len;               /* size of the cache file */
+};
+
+/* Built with LC_STATS defined, the interpreter counts the
+   work done on its hot paths, and --stats reports the counts.
+   Otherwise COUNT() and COUNT_MAX() are nothing.
+*/
+#ifdef LC_STATS
+struct lc_counts {
+	long tokens;       /* tokens read by get_token() */
+	long putbacks;     /* calls of putback() */
+	long var_lookups;  /* calls of find_var(), assign_var() and is_var() */
+	long compares;     /* names compared with strcmp() */
+	long func_lookups; /* functions looked up by name */
+	long calls;        /* calls of functions in the program */
+	long builtins;     /* calls of library functions */
+	int max_lvartos;   /* deepest the local variable stack got */
+	int max_functos;   /* deepest the call stack got */
+};
+#define COUNT(c) ((void)lc->counts.c++)
+#define COUNT_MAX(c, n) ((void)(lc->counts.c < (n) && (lc->counts.c = (n))))
+#else
+#define COUNT(c) ((void)0)
+#define COUNT_MAX(c, n) ((void)0)
+#endif
+
+/* Everything an interpreter changes while it prepares or
+   runs a program. Each thread running programs has its own,
+   which lc points to.
+*/
+struct lc_interp {
+	struct lc_program *pg; /* program being prepared or run */
+	jmp_buf e_buf;         /* hold environment for longjmp() */
+	int status;            /* exit status when e_buf is jumped to */
+
+	FILE *in, *out;        /* the program's input, which may be NULL
+							  for none, and output */
+	int out_buffer;        /* size of the output buffer */
+	int flush;             /* when the output buffer is written out */
+	int engine;            /* how the program is run */
+	int stats;             /* report statistics on stderr */
+	int jit;               /* compile hot functions to native code */
+	int opt;               /* optimization level, 0 or 1 */
+	int max_locals, max_calls, max_globals; /* limits on the tables */
+	char *cache_dir;       /* directory of prepared programs, or NULL */
+	char *profile;         /* file a profile of the run is written to, or NULL */
+	struct lc_profile *prof; /* the profile being taken */
+
+	struct token_rec *prog;    /* current location in program */
+	struct token_rec *cur_tok; /* record of the current token */
+	char *token;               /* string representation of token */
+	char token_type;           /* contains type of token */
+	char tok;                  /* internal representation of token */
+
+	int *globals;              /* values of the global variables */
+	int *local_var_stack;      /* frames of the calls in progress */
+	int lvartos, lvar_size;    /* top of and entries allocated for local_var_stack */
+	int frame;                 /* start of the running function's frame */
+	int *call_stack;
+	int functos, call_size;    /* top of and entries allocated for call_stack */
+
+	char *obuf;                /* output waiting to be written to out */
+	int olen, osize;           /* bytes in and allocated for obuf */
+
+	int ret_value;       /* function return value */
+	int ret_occurring;   /* function return is occurring */
+	int tail_occurring;  /* the return is a tail call */
+	int break_occurring; /* loop break is occurring */
+	int cont_occurring;  /* loop continue is occurring */
+	long statements;     /* statements the token walker has run */
+#ifdef LC_STATS
+	struct lc_counts counts; /* work done since it was last reported */
+#endif
+
+	int *vm_stack;             /* the stack machine's stack, counted against max_locals */
+	int vm_stack_size;
+	struct vm_frame *vm_frames; /* one for each call in progress */
+	int vm_frame_size;
+	int vm_fp;                 /* calls in progress on the stack machine */
+	struct jit_func *jit_funcs; /* native code of each function, with --jit */
+	int jit_compiled;          /* functions compiled to native code */
+
+	/* used while a program is prepared */
+	char *lex_p;            /* lexer position in the source */
+	int lex_line;           /* line the lexer is on */
+	int op_text[256];       /* text of each delimiter in t_pool, by its
+							   first character, or -1 */
+	int vm_depth, vm_max_depth; /* stack use of the code compiled so far */
+	int vm_brk;             /* break jumps of the innermost loop, waiting for a target */
+	int vm_cont;            /* continue jumps of the innermost loop */
+	char vm_started;        /* a statement has been compiled in the function */
+	int vm_last;            /* offset of the last operation compiled */
+	int folds;              /* expressions the optimizer simplified */
+};
+
+#if defined(_MSC_VER)
+#define LC_THREAD __declspec(thread)
+#elif defined(__GNUC__)
+#define LC_THREAD __thread
+#else
+#define LC_THREAD /* no threads, so one interpreter at a time */
+#endif
+
+extern LC_THREAD struct lc_interp *lc; /* the interpreter at work */
+extern struct commands table[];
+
+/* littlec.c */
+void init_interp(struct lc_interp *ip), free_interp(struct lc_interp *ip);
+struct lc_program *prepare_program(char *fname, const char *source);
+int run_program(struct lc_program *pg);
+void free_program(struct lc_program *pg);
+void call(int f);
+void assign_var(struct token_rec *t, int value);
+int find_var(struct token_rec *t), is_var(struct token_rec *t);
+int find_func(char *name);
+void *grow_table(void *table, int *size, int elem, int limit, int error);
+
+/* The token get_token() will read next. It can be looked
+   at in place, so deciding what to do next never needs a
+   token to be read and put back.
+*/
+#define PEEK() (lc->prog)
+#define PEEK_TEXT() (lc->pg->t_pool[lc->prog->text]) /* its first character */
+
+/* parser.c */
+void eval_exp(int *value), eval_exp0(int *value), putback(void);
+void lex_program(void), fold_program(void), set_token(struct token_rec *t);
+char get_token(void), look_up(char *s, int n);
+int internal_func(char *s), find_ident(char *s);
+#if defined(_MSC_VER) && _MSC_VER >= 1200
+__declspec(noreturn) void sntx_err(int error);
+__declspec(noreturn) void stop_program(int status);
+#elif __GNUC__
+void sntx_err(int error) __attribute((noreturn));
+void stop_program(int status) __attribute((noreturn));
+#else
+void sntx_err(int error);
+void stop_program(int status);
+#endif
+
+/* lclib.c */
+int call_getche(void), call_putch(void);
+int call_puts(void), print(void), getnum(void);
+int read_char(void), read_num(void);
+void out_char(int c), out_text(char *s, int n), out_num(int n);
+void out_string(int s);
+void out_flush(void);
+
+#endif
@@ -8,80 +8,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 
-#define NUM_FUNC        100
-#define NUM_GLOBAL_VARS 100
-#define NUM_LOCAL_VARS  200
-#define ID_LEN          32
-#define FUNC_CALLS      31
-#define PROG_SIZE       10000
-#define FOR_NEST        31
-
-// Secure function compatibility
-#if !defined(_MSC_VER) || _MSC_VER < 1400
-#define strcpy_s(dest, count, source) strncpy( (dest), (source), (count) )
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(LC_NO_SIMD)
+#define LC_SIMD /* the lexer scans runs of characters a vector at a time */
+#include <immintrin.h>
 #endif
 
-enum tok_types {
-	DELIMITER, IDENTIFIER, NUMBER, KEYWORD,
-	TEMP, STRING, BLOCK
-};
-
-enum tokens {
-	ARG, CHAR, INT, IF, ELSE, FOR, DO, WHILE,
-	SWITCH, RETURN, CONTINUE, BREAK, EOL, FINISHED, END
-};
-
-enum double_ops { LT = 1, LE, GT, GE, EQ, NE };
-
-/* These are the constants used to call sntx_err() when
-   a syntax error occurs. Add more if you like.
-   NOTE: SYNTAX is a generic error message used when
-   nothing else seems appropriate.
-*/
-enum error_msg
-{
-	SYNTAX, UNBAL_PARENS, NO_EXP, EQUALS_EXPECTED,
-	NOT_VAR, PARAM_ERR, SEMI_EXPECTED,
-	UNBAL_BRACES, FUNC_UNDEF, TYPE_EXPECTED,
-	NEST_FUNC, RET_NOCALL, PAREN_EXPECTED,
-	WHILE_EXPECTED, QUOTE_EXPECTED, NOT_TEMP,
-	TOO_MANY_LVARS, DIV_BY_ZERO
-};
-
-extern char *prog;  /* current location in source code */
-extern char *p_buf;  /* points to start of program buffer */
-extern jmp_buf e_buf; /* hold environment for longjmp() */
+#include "littlec.h"
 
-/* An array of these structures will hold the info
-   associated with global variables.
-*/
-extern struct var_type {
-	char var_name[ID_LEN];
-	int v_type;
-	int value;
-}  global_vars[NUM_GLOBAL_VARS];
-
-/*  This is the function call stack. */
-extern struct func_type {
-	char func_name[ID_LEN];
-	int ret_type;
-	char *loc;  /* location of function entry point in file */
-} func_stack[NUM_FUNC];
-
-/* Keyword table */
-extern struct commands {
-	char command[20];
-	char tok;
-} table[];
-
-/* "Standard library" functions are declared here so
-   they can be put into the internal function table that
+/* "Standard library" functions are declared in littlec.h
+   so they can be put into the internal function table that
    follows.
  */
-int call_getche(void), call_putch(void);
-int call_puts(void), print(void), getnum(void);
-
 struct intern_func_type {
 	char *f_name; /* function name */
 	int(*p)(void);   /* pointer to the function */
@@ -94,11 +33,41 @@ struct intern_func_type {
 	{ "", 0 } /* null terminate the list */
 };
 
-extern char token[80]; /* string representation of token */
-extern char token_type; /* contains type of token */
-extern char tok; /* internal representation of token */
+/* The lexer classifies each character of the source by
+   looking it up in char_class[], which holds these bits.
+*/
+#define C_DELIM 0x01 /* ends a number or identifier, as isdelim() */
+#define C_WHITE 0x02 /* space or tab */
+#define C_EOL   0x04 /* ends a line: \r, \n or the end of the source */
+#define C_DIGIT 0x08
+#define C_ALPHA 0x10
+#define C_BLOCK 0x20 /* { or } */
+#define C_RELOP 0x40 /* starts a relational operator */
+#define C_OP    0x80 /* a delimiter token of one character */
+
+static const unsigned char char_class[256] = {
+	0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x05, 0x00, 0x00, 0x05, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x03, 0x41, 0x00, 0x00, 0x00, 0x81, 0x00, 0x01, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x00, 0x81,
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x00, 0x81, 0x41, 0xc1, 0x41, 0x00,
+	0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+	0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x81, 0x00,
+	0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+	0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x20, 0x00, 0x20, 0x00, 0x00
+	/* characters above 127 are none of these */
+};
+
+#define CLASS(c) (char_class[(unsigned char)(c)])
 
-extern int ret_value; /* function return value */
+/* The runs of characters scan_run() passes over. */
+enum runs {
+	RUN_WHITE,   /* spaces and tabs */
+	RUN_WORD,    /* letters, digits and underscores, or with
+				    LC_SIMD undefined, anything but a delimiter */
+	RUN_COMMENT, /* the body of a comment, up to a *, a \r
+				    or the end of the source */
+	RUN_LINE     /* the rest of a line */
+};
 
 void eval_exp0(int *value);
 void eval_exp(int *value);
@@ -108,33 +77,23 @@ void eval_exp3(int *value);
 void eval_exp4(int *value);
 void eval_exp5(int *value);
 void atom(int *value);
-#if defined(_MSC_VER) && _MSC_VER >= 1200
-__declspec(noreturn) void sntx_err(int error);
-#elif __GNUC__
-void sntx_err(int error) __attribute((noreturn));
-#else
-void sntx_err(int error);
-#endif
-
-void putback(void);
-void assign_var(char *var_name, int value);
 int isdelim(char c), iswhite(char c);
-int find_var(char *s);
-int internal_func(char *s);
-int is_var(char *s);
-char *find_func(char *name), look_up(char *s), get_token(void);
-void call(void);
-static void str_replace(char *line, const char *search, const char *replace);
+static void scan_token(struct token_rec *t), match_brackets(void);
+static char *scan_run(char *p, int kind, int *lines);
+static int add_text(char *s, int n), share_text(char *s, int n), share_op(char *s, int n);
+static int intern(char *s, int n);
+static unsigned hash_text(char *s, int n);
+static int decode_string(char *s, int n);
 
 /* Entry point into parser. */
 void eval_exp(int *value)
 {
 	get_token();
-	if (!*token) {
+	if (!*lc->token) {
 		sntx_err(NO_EXP);
 		return;
 	}
-	if (*token == ';') {
+	if (*lc->token == ';') {
 		*value = 0; /* empty expression */
 		return;
 	}
@@ -145,27 +104,17 @@ void eval_exp(int *value)
 /* Process an assignment expression */
 void eval_exp0(int *value)
 {
-	char temp[ID_LEN];  /* holds name of var receiving
-						   the assignment */
-	register char temp_tok;
-
-	if (token_type == IDENTIFIER) {
-		if (is_var(token)) {  /* if a var, see if assignment */
-			strcpy_s(temp, ID_LEN, token);
-			temp_tok = token_type;
-			get_token();
-			if (*token == '=') {  /* is an assignment */
-				get_token();
-				eval_exp0(value);  /* get value to assign */
-				assign_var(temp, *value);  /* assign the value */
-				return;
-			}
-			else {  /* not an assignment */
-				putback();  /* restore original token */
-				strcpy_s(token, 80, temp);
-				token_type = temp_tok;
-			}
-		}
+	struct token_rec *temp;  /* holds var receiving
+							    the assignment */
+
+	/* if a var followed by =, it is an assignment */
+	if (lc->token_type == IDENTIFIER && is_var(lc->cur_tok) && PEEK_TEXT() == '=') {
+		temp = lc->cur_tok;
+		get_token(); /* the = */
+		get_token();
+		eval_exp0(value);  /* get value to assign */
+		assign_var(temp, *value);  /* assign the value */
+		return;
 	}
 	eval_exp1(value);
 }
@@ -180,7 +129,7 @@ void eval_exp1(int *value)
 	};
 
 	eval_exp2(value);
-	op = *token;
+	op = *lc->token;
 	if (strchr(relops, op)) {
 		get_token();
 		eval_exp2(&partial_value);
@@ -214,7 +163,7 @@ void eval_exp2(int *value)
 	int partial_value;
 
 	eval_exp3(value);
-	while ((op = *token) == '+' || op == '-') {
+	while ((op = *lc->token) == '+' || op == '-') {
 		get_token();
 		eval_exp3(&partial_value);
 		switch (op) { /* add or subtract */
@@ -235,7 +184,7 @@ void eval_exp3(int *value)
 	int partial_value, t;
 
 	eval_exp4(value);
-	while ((op = *token) == '*' || op == '/' || op == '%') {
+	while ((op = *lc->token) == '*' || op == '/' || op == '%') {
 		get_token();
 		eval_exp4(&partial_value);
 		switch (op) { /* mul, div, or modulus */
@@ -244,9 +193,12 @@ void eval_exp3(int *value)
 			break;
 		case '/':
 			if (partial_value == 0) sntx_err(DIV_BY_ZERO);
+			if (partial_value == -1 && *value == INT_MIN) sntx_err(INT_OVERFLOW); /* traps like / 0 */
 			*value = (*value) / partial_value;
 			break;
 		case '%':
+			if (partial_value == 0) sntx_err(DIV_BY_ZERO);
+			if (partial_value == -1 && *value == INT_MIN) sntx_err(INT_OVERFLOW);
 			t = (*value) / partial_value;
 			*value = *value - (t * partial_value);
 			break;
@@ -260,8 +212,8 @@ void eval_exp4(int *value)
 	register char  op;
 
 	op = '\0';
-	if (*token == '+' || *token == '-') {
-		op = *token;
+	if (lc->token_type == DELIMITER && (*lc->token == '+' || *lc->token == '-')) {
+		op = *lc->token;
 		get_token();
 	}
 	eval_exp5(value);
@@ -272,10 +224,10 @@ void eval_exp4(int *value)
 /* Process parenthesized expression. */
 void eval_exp5(int *value)
 {
-	if (*token == '(') {
+	if (*lc->token == '(') {
 		get_token();
 		eval_exp0(value);   /* get subexpression */
-		if (*token != ')') sntx_err(PAREN_EXPECTED);
+		if (*lc->token != ')') sntx_err(PAREN_EXPECTED);
 		get_token();
 	}
 	else
@@ -285,35 +237,25 @@ void eval_exp5(int *value)
 /* Find value of number, variable, or function. */
 void atom(int *value)
 {
-	int i;
-
-	switch (token_type) {
+	switch (lc->token_type) {
 	case IDENTIFIER:
-		i = internal_func(token);
-		if (i != -1) {  /* call "standard library" function */
-			*value = (*intern_func[i].p)();
+		if (lc->cur_tok->bind == BIND_BUILTIN) {  /* call "standard library" function */
+			COUNT(builtins);
+			*value = (*intern_func[lc->cur_tok->value].p)();
 		}
-		else if (find_func(token)) { /* call user-defined function */
-			call();
-			*value = ret_value;
+		else if (lc->cur_tok->bind == BIND_FUNC) { /* call user-defined function */
+			call(lc->cur_tok->value);
+			*value = lc->ret_value;
 		}
-		else *value = find_var(token); /* get var's value */
+		else *value = find_var(lc->cur_tok); /* get var's value */
 		get_token();
 		return;
-	case NUMBER: /* is numeric constant */
-		*value = atoi(token);
+	case NUMBER: /* is numeric or character constant */
+		*value = lc->cur_tok->value;
 		get_token();
 		return;
-	case DELIMITER: /* see if character constant */
-		if (*token == '\'') {
-			*value = *prog;
-			prog++;
-			if (*prog != '\'') sntx_err(QUOTE_EXPECTED);
-			prog++;
-			get_token();
-			return;
-		}
-		if (*token == ')') return; /* process empty expression */
+	case DELIMITER:
+		if (*lc->token == ')') return; /* process empty expression */
 		else sntx_err(SYNTAX); /* syntax error */
 	default:
 		sntx_err(SYNTAX); /* syntax error */
@@ -323,8 +265,8 @@ void atom(int *value)
 /* Display an error message. */
 void sntx_err(int error)
 {
-	char *p, *temp;
-	int linecount = 0;
+	char *p;
+	int linecount;
 	register int i;
 
 	static char *e[] = {
@@ -345,236 +287,479 @@ void sntx_err(int error)
 	  "closing quote expected",
 	  "not a string",
 	  "too many local variables",
-	  "division by zero"
+	  "division by zero",
+	  "integer overflow",
+	  "too many global variables"
 	};
-	printf("\n%s", e[error]);
-	p = p_buf;
-	while (p != prog && *p != '\0') {  /* find line number of error */
-		p++;
-		if (*p == '\r') {
-			linecount++;
-			if (p == prog) {
-				break;
-			}
-			/* See if this is a Windows or Mac newline */
-			p++;
-			/* If we are a mac, backtrack */
-			if (*p != '\n') {
-				p--;
-			}
-		}
-		else if (*p == '\n') {
-			linecount++;
-		}
-		else if (*p == '\0') {
-			linecount++;
-		}
+	out_char('\n');
+	out_text(e[error], (int)strlen(e[error]));
+	if (lc->cur_tok) { /* error while interpreting */
+		p = lc->pg->p_buf + lc->cur_tok->offset;
+		linecount = lc->cur_tok->line;
+	}
+	else { /* error while lexing */
+		p = lc->lex_p;
+		linecount = lc->lex_line;
 	}
-	printf(" in line %d\n", linecount);
+	out_text(" in line ", 9);
+	out_num(linecount);
+	out_char('\n');
 
-	temp = p--;
-	for (i = 0; i < 20 && p > p_buf && *p != '\n' && *p != '\r'; i++, p--);
-	for (i = 0; i < 30 && p <= temp; i++, p++) printf("%c", *p);
+	/* show the line up to 20 characters before the error */
+	for (i = 0; i < 20 && p > lc->pg->p_buf && p[-1] != '\n' && p[-1] != '\r'; i++, p--);
+	for (i = 0; i < 30 && *p && *p != '\n' && *p != '\r'; i++, p++) out_char(*p);
 
-	longjmp(e_buf, 1); /* return to safe point */
+	stop_program(1); /* return to safe point */
 }
 
-/* Get a token. */
-char get_token(void)
+/* Stop running the program, with the given exit status. */
+void stop_program(int status)
+{
+	lc->status = status;
+	longjmp(lc->e_buf, 1);
+}
+
+/* Convert the program source into an array of tokens.
+   This is done once, after the program is loaded, so that
+   running the program never rescans the source text.
+*/
+void lex_program(void)
+{
+	struct lc_program *pg;
+	struct token_rec *t;
+
+	pg = lc->pg;
+	lc->cur_tok = NULL;
+	lc->lex_p = pg->p_buf;
+	lc->lex_line = 1;
+	memset(lc->op_text, -1, sizeof(lc->op_text));
+	pg->tok_count = 0;
+	do {
+		if (pg->tok_count == pg->tok_size) { /* grow the token array */
+			pg->tok_size = pg->tok_size ? pg->tok_size * 2 : 256;
+			pg->tok_buf = (struct token_rec *)realloc(pg->tok_buf, pg->tok_size * sizeof(struct token_rec));
+			if (pg->tok_buf == NULL) {
+				printf("Allocation Failure");
+				exit(1);
+			}
+		}
+		t = &pg->tok_buf[pg->tok_count++];
+		scan_token(t);
+	} while (t->tok != FINISHED);
+	match_brackets();
+}
+
+/* Link every parenthesis and curly brace with the one that
+   matches it, so the interpreter can skip over a block or
+   a parenthesized list without counting its way through.
+*/
+static void match_brackets(void)
 {
+	struct lc_program *pg;
+	struct token_rec *t;
+	int *open, top, i;
+	char c;
+
+	pg = lc->pg;
+	open = (int *)malloc(pg->tok_count * sizeof(int)); /* stack of unmatched openings */
+	if (open == NULL) {
+		printf("Allocation Failure");
+		exit(1);
+	}
+	top = 0;
+	for (i = 0; i < pg->tok_count; i++) {
+		t = &pg->tok_buf[i];
+		if (t->token_type != BLOCK && t->token_type != DELIMITER) continue;
+		c = pg->t_pool[t->text];
+		if (c == '(' || c == '{') open[top++] = i;
+		else if (c == ')' || c == '}') {
+			if (!top) { /* nothing left to close */
+				set_token(t);
+				sntx_err(c == ')' ? UNBAL_PARENS : UNBAL_BRACES);
+			}
+			if (pg->t_pool[pg->tok_buf[open[top - 1]].text] != (c == ')' ? '(' : '{')) break;
+			t->value = open[--top];
+			pg->tok_buf[t->value].value = i;
+		}
+	}
+	if (top) { /* report the innermost opening left unclosed */
+		set_token(&pg->tok_buf[open[top - 1]]);
+		sntx_err(pg->t_pool[pg->tok_buf[open[top - 1]].text] == '(' ? UNBAL_PARENS : UNBAL_BRACES);
+	}
+	free(open);
+}
 
+/* Scan the next token of the source into t. */
+static void scan_token(struct token_rec *t)
+{
+	struct lc_program *pg;
 	register char *temp;
+	char ops[3];
+	int i, n;
+
+	pg = lc->pg;
+	t->token_type = 0; t->tok = 0;
+	t->bind = BIND_NONE;
+	t->id = -1; t->value = 0; t->skip = 0;
+
+	/* skip over white space, newlines and comments */
+	for (;;) {
+		lc->lex_p = scan_run(lc->lex_p, RUN_WHITE, NULL);
+
+		if (*lc->lex_p == '\r') { /* Windows or Mac newline */
+			++lc->lex_p;
+			/* Only skip \n if it exists (if it doesn't, we are running on mac) */
+			if (*lc->lex_p == '\n') ++lc->lex_p;
+			lc->lex_line++;
+		}
+		else if (*lc->lex_p == '\n') { /* Unix newline */
+			++lc->lex_p;
+			lc->lex_line++;
+		}
+		else if (*lc->lex_p == '/' && *(lc->lex_p + 1) == '*') { /* is a comment */
+			lc->lex_p += 2;
+			for (;;) {
+				lc->lex_p = scan_run(lc->lex_p, RUN_COMMENT, &lc->lex_line);
+				if (*lc->lex_p == '*') {
+					if (*(lc->lex_p + 1) == '/') break;
+				}
+				else if (*lc->lex_p == '\r') {
+					if (*(lc->lex_p + 1) != '\n') lc->lex_line++;
+				}
+				else break; /* end of the source */
+				lc->lex_p++;
+			}
+			if (*lc->lex_p) lc->lex_p += 2;
+		}
+		else if (*lc->lex_p == '/' && *(lc->lex_p + 1) == '/') { /* C++ style comment */
+			/* find end of line */
+			lc->lex_p = scan_run(lc->lex_p, RUN_LINE, NULL);
+		}
+		else break;
+	}
 
-	token_type = 0; tok = 0;
+	t->offset = (int)(lc->lex_p - pg->p_buf);
+	t->line = lc->lex_line;
 
-	temp = token;
-	*temp = '\0';
+	if (*lc->lex_p == '\0') { /* end of file */
+		t->text = share_op("", 0);
+		t->tok = FINISHED;
+		t->token_type = DELIMITER;
+		return;
+	}
 
-	/* skip over white space */
-	while (iswhite(*prog) && *prog) ++prog;
+	if (CLASS(*lc->lex_p) & C_BLOCK) { /* block delimiters */
+		t->text = share_op(lc->lex_p, 1);
+		lc->lex_p++;
+		t->token_type = BLOCK;
+		return;
+	}
 
-	/* Handle Windows and Mac newlines */
-	if (*prog == '\r') {
-		++prog;
-		/* Only skip \n if it exists (if it doesn't, we are running on mac) */
-		if (*prog == '\n') {
-			++prog;
+	if (CLASS(*lc->lex_p) & C_RELOP) { /* is or might be
+									 a relational operator */
+		ops[0] = '\0';
+		switch (*lc->lex_p) {
+		case '=':
+			if (*(lc->lex_p + 1) == '=') {
+				ops[0] = ops[1] = EQ; ops[2] = '\0';
+			}
+			break;
+		case '!':
+			if (*(lc->lex_p + 1) == '=') {
+				ops[0] = ops[1] = NE; ops[2] = '\0';
+			}
+			break;
+		case '<':
+			if (*(lc->lex_p + 1) == '=') {
+				ops[0] = ops[1] = LE; ops[2] = '\0';
+			}
+			else {
+				ops[0] = LT; ops[1] = '\0';
+			}
+			break;
+		case '>':
+			if (*(lc->lex_p + 1) == '=') {
+				ops[0] = ops[1] = GE; ops[2] = '\0';
+			}
+			else {
+				ops[0] = GT; ops[1] = '\0';
+			}
+			break;
+		}
+		if (*ops) {
+			lc->lex_p += ops[1] ? 2 : 1;
+			t->text = share_op(ops, (int)strlen(ops));
+			t->token_type = DELIMITER;
+			return;
 		}
-		/* skip over white space */
-		while (iswhite(*prog) && *prog) ++prog;
 	}
 
-	/* Handle Unix newlines */
-	if (*prog == '\n') {
-		++prog;
-		/* skip over white space */
-		while (iswhite(*prog) && *prog) ++prog;
+	if (CLASS(*lc->lex_p) & C_OP) { /* delimiter */
+		t->text = share_op(lc->lex_p, 1);
+		lc->lex_p++; /* advance to next position */
+		t->token_type = DELIMITER;
+		return;
 	}
 
-	if (*prog == '\0') { /* end of file */
-		*token = '\0';
-		tok = FINISHED;
-		return (token_type = DELIMITER);
+	if (*lc->lex_p == '\'') { /* character constant */
+		if (*(lc->lex_p + 1) == '\0' || *(lc->lex_p + 2) != '\'') sntx_err(QUOTE_EXPECTED);
+		t->value = *(lc->lex_p + 1);
+		t->text = share_text(lc->lex_p, 3);
+		lc->lex_p += 3;
+		t->token_type = NUMBER;
+		return;
 	}
 
-	if (strchr("{}", *prog)) { /* block delimiters */
-		*temp = *prog;
-		temp++;
-		*temp = '\0';
-		prog++;
-		return (token_type = BLOCK);
+	if (*lc->lex_p == '"') { /* quoted string */
+		temp = ++lc->lex_p;
+		while (*temp != '"' && !(CLASS(*temp) & C_EOL))
+			temp += *temp == '\\' && !(CLASS(temp[1]) & C_EOL) ? 2 : 1;
+		if (*temp != '"') {
+			lc->lex_p = temp;
+			sntx_err(SYNTAX);
+		}
+		if (pg->str_count == pg->str_size) { /* grow the string table */
+			pg->str_size = pg->str_size ? pg->str_size * 2 : 16;
+			pg->str_table = (struct str_type *)realloc(pg->str_table, pg->str_size * sizeof(struct str_type));
+			if (pg->str_table == NULL) {
+				printf("Allocation Failure");
+				exit(1);
+			}
+		}
+		n = (int)(temp - lc->lex_p);
+		t->text = add_text(lc->lex_p, n);
+		lc->lex_p = temp + 1;
+		n = decode_string(pg->t_pool + t->text, n);
+		pg->t_len = t->text + n + 1; /* give back what the escapes saved */
+		pg->str_table[pg->str_count].text = t->text;
+		pg->str_table[pg->str_count].len = n;
+		t->value = pg->str_count++;
+		t->token_type = STRING;
+		return;
 	}
 
-	/* look for comments */
-	if (*prog == '/')
-		if (*(prog + 1) == '*') { /* is a comment */
-			prog += 2;
-			do { /* find end of comment */
-				while (*prog != '*' && *prog != '\0') prog++;
-				if (*prog == '\0') {
-					prog--;
-					break;
-				}
-				prog++;
-			} while (*prog != '/');
-			prog++;
+	if (CLASS(*lc->lex_p) & C_DIGIT) { /* number */
+		temp = scan_run(lc->lex_p, RUN_WORD, NULL);
+		while (!(CLASS(*temp) & C_DELIM)) temp = scan_run(temp + 1, RUN_WORD, NULL);
+		t->text = share_text(lc->lex_p, (int)(temp - lc->lex_p));
+		lc->lex_p = temp;
+		t->value = atoi(pg->t_pool + t->text);
+		t->token_type = NUMBER;
+		return;
+	}
+
+	if (CLASS(*lc->lex_p) & C_ALPHA) { /* var or command */
+		temp = scan_run(lc->lex_p, RUN_WORD, NULL);
+		while (!(CLASS(*temp) & C_DELIM)) temp = scan_run(temp + 1, RUN_WORD, NULL);
+		i = intern(lc->lex_p, (int)(temp - lc->lex_p));
+		lc->lex_p = temp;
+
+		/* each distinct name was looked up when it was interned */
+		t->text = pg->id_text[i];
+		t->tok = pg->id_tok[i];
+		if (t->tok) t->token_type = KEYWORD; /* is a keyword */
+		else {
+			t->token_type = IDENTIFIER;
+			t->id = i;
 		}
+		return;
+	}
 
-	/* look for C++ style comments */
-	if (*prog == '/')
-		if (*(prog + 1) == '/') { /* is a comment */
-			prog += 2;
-			/* find end of line */
-			while (*prog != '\r' && *prog != '\n' && *prog != '\0') prog++;
-			if (*prog == '\r' && *(prog + 1) == '\n') {
-				prog++;
-			}
+	sntx_err(SYNTAX); /* not a character Little C knows */
+}
+
+/* Append n characters of s to the token text pool and
+   return the offset of the new, null terminated, text.
+*/
+static int add_text(char *s, int n)
+{
+	struct lc_program *pg;
+	int offset;
+
+	pg = lc->pg;
+	if (pg->t_len + n + 1 > pg->t_size) { /* grow the pool */
+		while (pg->t_len + n + 1 > pg->t_size) pg->t_size = pg->t_size ? pg->t_size * 2 : 1024;
+		pg->t_pool = (char *)realloc(pg->t_pool, pg->t_size);
+		if (pg->t_pool == NULL) {
+			printf("Allocation Failure");
+			exit(1);
 		}
+	}
+	offset = pg->t_len;
+	memcpy(pg->t_pool + offset, s, n);
+	pg->t_pool[offset + n] = '\0';
+	pg->t_len += n + 1;
+	return offset;
+}
 
-	/* look for the end of file after a comment */
-	if (*prog == '\0') { /* end of file */
-		*token = '\0';
-		tok = FINISHED;
-		return (token_type = DELIMITER);
-	}
-
-	if (strchr("!<>=", *prog)) { /* is or might be
-								   a relational operator */
-		switch (*prog) {
-		case '=': if (*(prog + 1) == '=') {
-			prog++; prog++;
-			*temp = EQ;
-			temp++; *temp = EQ; temp++;
-			*temp = '\0';
-		}
-				  break;
-		case '!': if (*(prog + 1) == '=') {
-			prog++; prog++;
-			*temp = NE;
-			temp++; *temp = NE; temp++;
-			*temp = '\0';
-		}
-				  break;
-		case '<': if (*(prog + 1) == '=') {
-			prog++; prog++;
-			*temp = LE; temp++; *temp = LE;
-		}
-				  else {
-					  prog++;
-					  *temp = LT;
-				  }
-				  temp++;
-				  *temp = '\0';
-				  break;
-		case '>': if (*(prog + 1) == '=') {
-			prog++; prog++;
-			*temp = GE; temp++; *temp = GE;
-		}
-				  else {
-					  prog++;
-					  *temp = GT;
-				  }
-				  temp++;
-				  *temp = '\0';
-				  break;
-		}
-		if (*token) return(token_type = DELIMITER);
-	}
-
-	if (strchr("+-*^/%=;(),'", *prog)) { /* delimiter */
-		*temp = *prog;
-		prog++; /* advance to next position */
-		temp++;
-		*temp = '\0';
-		return (token_type = DELIMITER);
-	}
-
-	if (*prog == '"') { /* quoted string */
-		prog++;
-		while ((*prog != '"' && *prog != '\r' && *prog != '\n' && *prog != '\0') || (*prog == '"' && *(prog - 1) == '\\')) *temp++ = *prog++;
-		if (*prog == '\r' || *prog == '\n' || *prog == '\0') sntx_err(SYNTAX);
-		prog++; *temp = '\0';
-		str_replace(token, "\\a", "\a");
-		str_replace(token, "\\b", "\b");
-		str_replace(token, "\\f", "\f");
-		str_replace(token, "\\n", "\n");
-		str_replace(token, "\\r", "\r");
-		str_replace(token, "\\t", "\t");
-		str_replace(token, "\\v", "\v");
-		str_replace(token, "\\\\", "\\");
-		str_replace(token, "\\\'", "\'");
-		str_replace(token, "\\\"", "\"");
-		return (token_type = STRING);
-	}
-
-	if (isdigit((int)*prog)) { /* number */
-		while (!isdelim(*prog)) *temp++ = *prog++;
-		*temp = '\0';
-		return (token_type = NUMBER);
-	}
-
-	if (isalpha((int)*prog)) { /* var or command */
-		while (!isdelim(*prog)) *temp++ = *prog++;
-		token_type = TEMP;
-	}
-
-	*temp = '\0';
-
-	/* see if a string is a command or a variable */
-	if (token_type == TEMP) {
-		tok = look_up(token); /* convert to internal rep */
-		if (tok) token_type = KEYWORD; /* is a keyword */
-		else token_type = IDENTIFIER;
-	}
-	return token_type;
+/* Return the offset in t_pool of the text of the delimiter
+   of n characters at s. Each delimiter is told apart by its
+   first character, so that is all that is looked at.
+*/
+static int share_op(char *s, int n)
+{
+	int c;
+
+	c = (unsigned char)*s;
+	if (lc->op_text[c] < 0) lc->op_text[c] = add_text(s, n);
+	return lc->op_text[c];
 }
 
-/* Return a token to input stream. */
-void putback(void)
+/* Return the offset in t_pool of the text of a token of n
+   characters at s. Tokens spelled the same share one copy.
+*/
+static int share_text(char *s, int n)
 {
-	char *t;
+	int i;
 
-	t = token;
-	for (; *t; t++) prog--;
+	i = intern(s, n); /* which may move id_text */
+	return lc->pg->id_text[i];
 }
 
-/* Look up a token's internal representation in the
-   token table.
+/* Return the number of the text of n characters at s,
+   adding it to t_pool, and looking up whether it is a
+   keyword, if it is new. Keywords, numbers and delimiters
+   are interned as well as names, so each spelling of each
+   is only copied and looked up once. Names, as in C of old,
+   are not case sensitive: they are kept in lower case, so
+   Total, TOTAL and total are one name.
 */
-char look_up(char *s)
+static int intern(char *s, int n)
 {
-	register int i;
-	char *p;
+	struct lc_program *pg;
+	unsigned h;
+	int i, j, fold, *old, old_size;
+	char *text;
+
+	pg = lc->pg;
+	fold = (CLASS(*s) & C_ALPHA) != 0; /* a name or keyword */
+	if (2 * (pg->id_count + 1) > pg->id_hash_size) { /* grow and rehash */
+		old = pg->id_hash;
+		old_size = pg->id_hash_size;
+		pg->id_hash_size = pg->id_hash_size ? pg->id_hash_size * 2 : 256;
+		pg->id_hash = (int *)calloc(pg->id_hash_size, sizeof(int));
+		pg->id_text = (int *)realloc(pg->id_text, (pg->id_hash_size / 2) * sizeof(int));
+		pg->id_tok = (char *)realloc(pg->id_tok, pg->id_hash_size / 2);
+		if (pg->id_hash == NULL || pg->id_text == NULL || pg->id_tok == NULL) {
+			printf("Allocation Failure");
+			exit(1);
+		}
+		for (i = 0; i < old_size; i++)
+			if (old[i]) {
+				text = pg->t_pool + pg->id_text[old[i] - 1];
+				h = hash_text(text, (int)strlen(text));
+				while (pg->id_hash[h & (pg->id_hash_size - 1)]) h++;
+				pg->id_hash[h & (pg->id_hash_size - 1)] = old[i];
+			}
+		free(old);
+	}
 
-	/* convert to lowercase */
-	p = s;
-	while (*p) { *p = (char)tolower(*p); p++; }
+	for (h = hash_text(s, n);; h++) {
+		i = pg->id_hash[h & (pg->id_hash_size - 1)];
+		if (!i) break;
+		COUNT(compares);
+		text = pg->t_pool + pg->id_text[i - 1];
+		if (fold) {
+			for (j = 0; j < n && (char)tolower((unsigned char)s[j]) == text[j]; j++) ;
+			if (j == n && text[n] == '\0') return i - 1;
+		}
+		else if (!memcmp(text, s, n) && text[n] == '\0') return i - 1;
+	}
+	pg->id_hash[h & (pg->id_hash_size - 1)] = pg->id_count + 1;
+	pg->id_text[pg->id_count] = add_text(s, n);
+	pg->id_tok[pg->id_count] = 0;
+	if (fold) {
+		text = pg->t_pool + pg->id_text[pg->id_count];
+		for (j = 0; j < n; j++) text[j] = (char)tolower((unsigned char)text[j]);
+		pg->id_tok[pg->id_count] = look_up(text, n);
+	}
+	return pg->id_count++;
+}
 
-	/* see if token is in table */
-	for (i = 0; *table[i].command; i++) {
-		if (!strcmp(table[i].command, s)) return table[i].tok;
+/* Return the number of the identifier s, or -1 if the
+   program does not use it.
+*/
+int find_ident(char *s)
+{
+	struct lc_program *pg;
+	unsigned h;
+	int i;
+
+	pg = lc->pg;
+	if (!pg->id_hash_size) return -1;
+	for (h = hash_text(s, (int)strlen(s));; h++) {
+		i = pg->id_hash[h & (pg->id_hash_size - 1)];
+		if (!i) return -1;
+		COUNT(compares);
+		if (!strcmp(pg->t_pool + pg->id_text[i - 1], s)) return i - 1;
 	}
-	return 0; /* unknown command */
+}
+
+/* Hash an identifier of n characters, ignoring case. */
+static unsigned hash_text(char *s, int n)
+{
+	unsigned h;
+
+	for (h = 2166136261u; n--; s++) h = (h ^ (unsigned char)tolower((unsigned char)*s)) * 16777619u; /* FNV-1a */
+	return h ^ (h >> 16); /* mix the high bits into the slot */
+}
+
+/* Get a token. */
+char get_token(void)
+{
+	register struct token_rec *t;
+
+	COUNT(tokens);
+	t = lc->prog;
+	if (t->tok != FINISHED) lc->prog = t + 1 + t->skip; /* stay on the end of the program */
+	set_token(t);
+	return lc->token_type;
+}
+
+/* Make t the current token. */
+void set_token(struct token_rec *t)
+{
+	lc->cur_tok = t;
+	lc->token = lc->pg->t_pool + t->text;
+	lc->token_type = t->token_type;
+	lc->tok = t->tok;
+}
+
+/* Return a token to input stream. */
+void putback(void)
+{
+	COUNT(putbacks);
+	lc->prog = lc->cur_tok;
+}
+
+/* Keywords are found by a perfect hash of their length
+   and first and last letters, in either case, which gives
+   each keyword in table[] its own slot in kw_slot[]. The
+   slot holds the keyword's index in table[] plus 1. Adding
+   a keyword to table[] means finding a hash that keeps them
+   apart and filling in kw_slot[] again.
+*/
+#define KW_HASH(s, n) (((n) + ((s)[0] | 0x20) + ((s)[(n) - 1] | 0x20)) & 31)
+
+static const char kw_slot[32] = {
+	7, 5, 0, 0, 0, 0, 8, 0, 0, 0, 0, 0, 11, 0, 2, 0,
+	9, 1, 10, 0, 0, 4, 0, 0, 0, 6, 0, 3, 0, 0, 0, 0
+};
+
+/* Return the internal representation of the keyword of n
+   characters at s, ignoring case, or 0 if it is not one.
+*/
+char look_up(char *s, int n)
+{
+	register int i;
+	const char *k;
+
+	i = kw_slot[KW_HASH(s, n)] - 1;
+	if (i < 0) return 0; /* unknown command */
+	COUNT(compares);
+	k = table[i].command;
+	for (; n && (*s | 0x20) == *k; n--) s++, k++; /* only letters are in table[] */
+	return !n && !*k ? table[i].tok : 0;
 }
 
 /* Return index of internal library function or -1 if
@@ -585,6 +770,7 @@ int internal_func(char *s)
 	int i;
 
 	for (i = 0; intern_func[i].f_name[0]; i++) {
+		COUNT(compares);
 		if (!strcmp(intern_func[i].f_name, s))  return i;
 	}
 	return -1;
@@ -593,29 +779,436 @@ int internal_func(char *s)
 /* Return true if c is a delimiter. */
 int isdelim(char c)
 {
-	if (strchr(" !;,+-<>'/*%^=()", c) || c == 9 ||
-		c == '\r' || c == '\n' || c == 0) return 1;
-	return 0;
+	return (CLASS(c) & C_DELIM) != 0;
 }
 
 /* Return 1 if c is space or tab. */
 int iswhite(char c)
 {
-	if (c == ' ' || c == '\t') return 1;
-	else return 0;
+	return (CLASS(c) & C_WHITE) != 0;
 }
 
-/* An in-place modification find and replace of the string.
-   Assumes the buffer pointed to by line is large enough to hold the resulting string.*/
-static void str_replace(char *line, const char *search, const char *replace)
+#ifdef LC_SIMD
+/* With SSE2, and AVX2 if the compiler may use it, runs of
+   characters are scanned a vector at a time, starting at the
+   run. The last load can read up to VEC_LEN - 1 bytes past
+   the null that ends the source, so every source buffer has
+   LC_PAD zero bytes from the null on.
+*/
+#ifdef __AVX2__
+#define VEC_LEN 32
+typedef __m256i vec_t;
+#define vec_load(p)   _mm256_loadu_si256((const __m256i *)(p))
+#define vec_set(c)    _mm256_set1_epi8(c)
+#define vec_eq(v, c)  _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define vec_lt(v, c)  _mm256_cmpgt_epi8(_mm256_set1_epi8(c), v)
+#define vec_add(v, c) _mm256_add_epi8(v, _mm256_set1_epi8(c))
+#define vec_or(a, b)  _mm256_or_si256(a, b)
+#define vec_mask(v)   ((unsigned)_mm256_movemask_epi8(v))
+#define VEC_ALL       0xffffffffu
+#else
+#define VEC_LEN 16
+typedef __m128i vec_t;
+#define vec_load(p)   _mm_loadu_si128((const __m128i *)(p))
+#define vec_set(c)    _mm_set1_epi8(c)
+#define vec_eq(v, c)  _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define vec_lt(v, c)  _mm_cmpgt_epi8(_mm_set1_epi8(c), v)
+#define vec_add(v, c) _mm_add_epi8(v, _mm_set1_epi8(c))
+#define vec_or(a, b)  _mm_or_si128(a, b)
+#define vec_mask(v)   ((unsigned)_mm_movemask_epi8(v))
+#define VEC_ALL       0xffffu
+#endif
+#if VEC_LEN > LC_PAD
+#error LC_PAD must cover a vector read past the end of the source
+#endif
+
+/* Return the first character at or after p that ends a run
+   of the given kind, adding the newlines passed over to
+   *lines if lines is not NULL. Every kind of run ends at the
+   null at the end of the source.
+*/
+static char *scan_run(char *p, int kind, int *lines)
 {
-	char *sp;
-	while ((sp = strstr(line, search)) != NULL) {
-		int search_len = (int)strlen(search);
-		int replace_len = (int)strlen(replace);
-		int tail_len = (int)strlen(sp + search_len);
+	vec_t v;
+	unsigned end, nl;
+
+	for (;; p += VEC_LEN) {
+		v = vec_load(p);
+		nl = 0;
+		switch (kind) {
+		case RUN_WHITE:
+			end = ~vec_mask(vec_or(vec_eq(v, ' '), vec_eq(v, '\t')));
+			break;
+		case RUN_WORD: /* the ranges are moved to the bottom of
+						  the signed bytes to compare them */
+			end = ~vec_mask(vec_or(vec_or(
+				vec_lt(vec_add(vec_or(v, vec_set(0x20)), 0x80 - 'a'), -0x80 + 26),
+				vec_lt(vec_add(v, 0x80 - '0'), -0x80 + 10)),
+				vec_eq(v, '_')));
+			break;
+		case RUN_COMMENT:
+			end = vec_mask(vec_or(vec_or(vec_eq(v, '*'), vec_eq(v, '\r')), vec_eq(v, 0)));
+			if (lines) nl = vec_mask(vec_eq(v, '\n'));
+			break;
+		default: /* RUN_LINE */
+			end = vec_mask(vec_or(vec_or(vec_eq(v, '\n'), vec_eq(v, '\r')), vec_eq(v, 0)));
+			break;
+		}
+		end &= VEC_ALL;
+		if (end) {
+			end = (unsigned)__builtin_ctz(end);
+			if (nl) *lines += __builtin_popcount(nl & ((1u << end) - 1));
+			return p + end;
+		}
+		if (nl) *lines += __builtin_popcount(nl);
+	}
+}
+#else
+/* Return the first character at or after p that ends a run
+   of the given kind, adding the newlines passed over to
+   *lines if lines is not NULL.
+*/
+static char *scan_run(char *p, int kind, int *lines)
+{
+	switch (kind) {
+	case RUN_WHITE:
+		while (CLASS(*p) & C_WHITE) p++;
+		break;
+	case RUN_WORD:
+		while (!(CLASS(*p) & C_DELIM)) p++;
+		break;
+	case RUN_COMMENT:
+		for (; *p != '*' && *p != '\r' && *p != '\0'; p++)
+			if (*p == '\n' && lines) ++*lines;
+		break;
+	default: /* RUN_LINE */
+		while (!(CLASS(*p) & C_EOL)) p++;
+		break;
+	}
+	return p;
+}
+#endif
+
+/* Replace the escape sequences in the n characters of the
+   string constant s with the characters they stand for,
+   null terminate it and return its new length. An escape
+   Little C does not know is left as it is.
+*/
+static int decode_string(char *s, int n)
+{
+	char *from, *to, *end;
 
-		memmove(sp + replace_len, sp + search_len, tail_len + 1);
-		memcpy(sp, replace, replace_len);
+	end = s + n;
+	for (from = to = s; from < end; from++) {
+		if (*from != '\\' || from + 1 == end) {
+			*to++ = *from;
+			continue;
+		}
+		switch (*++from) {
+		case 'a': *to++ = '\a'; break;
+		case 'b': *to++ = '\b'; break;
+		case 'f': *to++ = '\f'; break;
+		case 'n': *to++ = '\n'; break;
+		case 'r': *to++ = '\r'; break;
+		case 't': *to++ = '\t'; break;
+		case 'v': *to++ = '\v'; break;
+		case '\\': case '\'': case '"': *to++ = *from; break;
+		default: *to++ = '\\'; *to++ = *from; break;
+		}
 	}
-}
\ No newline at end of file
+	*to = '\0';
+	return (int)(to - s);
+}
+/* The optimizer. After the program is resolved, each
+   expression in it is parsed once more, following the same
+   grammar as eval_exp0() to atom(), to find its constant
+   parts. A constant subexpression of more than one token is
+   folded into its first token, which becomes a number, and
+   adding or subtracting 0, multiplying or dividing by 1 and
+   negating a negated variable are dropped. Nothing is taken
+   out of the token array; the token before what is dropped
+   is marked to skip it instead. A division or modulus by 0,
+   or of INT_MIN by -1, is never folded, so its division by
+   zero or integer overflow error is still reported when,
+   and if, the expression is run.
+*/
+
+struct fold_state {
+	int pos;  /* next token to parse */
+	int last; /* token before it */
+};
+
+static int fold_exp0(struct fold_state *fs, int *value);
+static int fold_exp1(struct fold_state *fs, int *value);
+static int fold_exp2(struct fold_state *fs, int *value);
+static int fold_exp3(struct fold_state *fs, int *value);
+static int fold_exp4(struct fold_state *fs, int *value);
+static int fold_exp5(struct fold_state *fs, int *value);
+static int fold_atom(struct fold_state *fs, int *value);
+static void fold_range(struct fold_state *fs, int start, int end, int value);
+
+/* Simplify every expression in the program. */
+void fold_program(void)
+{
+	struct lc_program *pg;
+	struct fold_state fs;
+	struct token_rec *t;
+	int i, value;
+
+	pg = lc->pg;
+	lc->folds = 0;
+	for (i = 0; pg->tok_buf[i].tok != FINISHED; i += 1 + t->skip) {
+		t = &pg->tok_buf[i];
+		if (t->token_type == KEYWORD ? t->tok != RETURN :
+			t->token_type != BLOCK && (t->token_type != DELIMITER ||
+				!strchr("(,=;", pg->t_pool[t->text])))
+			continue;
+		/* an expression can start after this token */
+		fs.last = i;
+		fs.pos = i + 1 + t->skip;
+		if (fold_exp0(&fs, &value)) fold_range(&fs, i + 1 + t->skip, fs.pos, value);
+	}
+}
+
+/* Return true if token i is the delimiter c. */
+static int fold_is(int i, char c)
+{
+	struct token_rec *t;
+
+	t = &lc->pg->tok_buf[i];
+	return t->token_type == DELIMITER && t->tok != FINISHED && lc->pg->t_pool[t->text] == c;
+}
+
+/* Move past the next token. */
+static void fold_advance(struct fold_state *fs)
+{
+	fs->last = fs->pos;
+	fs->pos += 1 + lc->pg->tok_buf[fs->pos].skip;
+}
+
+/* Fold the constant tokens from start up to end into the
+   first of them, if there is more than one.
+*/
+static void fold_range(struct fold_state *fs, int start, int end, int value)
+{
+	struct token_rec *t;
+	char buf[12];
+
+	t = &lc->pg->tok_buf[start];
+	if (start + 1 + t->skip == end) return; /* a single token */
+	t->token_type = NUMBER;
+	t->tok = 0;
+	t->bind = BIND_NONE;
+	t->id = -1;
+	t->value = value;
+	sprintf(buf, "%d", value);
+	t->text = add_text(buf, (int)strlen(buf));
+	t->skip = end - start - 1;
+	if (fs->pos == end) fs->last = start;
+	lc->folds++;
+}
+
+/* Drop the operator at op and its operand, which ends at the
+   current position, by skipping them after the token before op.
+*/
+static void fold_identity(struct fold_state *fs, int op)
+{
+	int prev;
+
+	if (fold_is(fs->pos, '=')) return; /* keep it an error */
+	for (prev = op - 1; prev + 1 + lc->pg->tok_buf[prev].skip != op; prev--);
+	lc->pg->tok_buf[prev].skip = fs->pos - prev - 1;
+	fs->last = prev;
+	lc->folds++;
+}
+
+/* An assignment expression. */
+static int fold_exp0(struct fold_state *fs, int *value)
+{
+	struct token_rec *t;
+	int start;
+
+	t = &lc->pg->tok_buf[fs->pos];
+	if (t->token_type == IDENTIFIER && is_var(t) && fold_is(fs->pos + 1 + t->skip, '=')) {
+		fold_advance(fs);
+		fold_advance(fs);
+		start = fs->pos;
+		if (fold_exp0(fs, value)) fold_range(fs, start, fs->pos, *value);
+		return 0;
+	}
+	return fold_exp1(fs, value);
+}
+
+/* A relational operator. */
+static int fold_exp1(struct fold_state *fs, int *value)
+{
+	struct token_rec *t;
+	int start, op_pos, right, is_const, partial_value;
+	char op;
+
+	start = fs->pos;
+	is_const = fold_exp2(fs, value);
+	t = &lc->pg->tok_buf[fs->pos];
+	op = lc->pg->t_pool[t->text];
+	if (t->token_type != DELIMITER || op < LT || op > NE) return is_const;
+	op_pos = fs->pos;
+	fold_advance(fs);
+	right = fs->pos;
+	if (fold_exp2(fs, &partial_value)) {
+		if (is_const) {
+			switch (op) {
+			case LT: *value = *value < partial_value; break;
+			case LE: *value = *value <= partial_value; break;
+			case GT: *value = *value > partial_value; break;
+			case GE: *value = *value >= partial_value; break;
+			case EQ: *value = *value == partial_value; break;
+			case NE: *value = *value != partial_value; break;
+			}
+			return 1;
+		}
+		fold_range(fs, right, fs->pos, partial_value);
+	}
+	else if (is_const) fold_range(fs, start, op_pos, *value);
+	return 0;
+}
+
+/* Adding or subtracting terms. */
+static int fold_exp2(struct fold_state *fs, int *value)
+{
+	int start, op_pos, right, is_const, partial_value;
+	char op;
+
+	start = fs->pos;
+	is_const = fold_exp3(fs, value);
+	while (fold_is(fs->pos, '+') || fold_is(fs->pos, '-')) {
+		op_pos = fs->pos;
+		op = lc->pg->t_pool[lc->pg->tok_buf[op_pos].text];
+		fold_advance(fs);
+		right = fs->pos;
+		if (fold_exp3(fs, &partial_value)) {
+			if (is_const) { /* arithmetic wraps, as it does when run */
+				if (op == '+') *value = (int)((unsigned)*value + (unsigned)partial_value);
+				else *value = (int)((unsigned)*value - (unsigned)partial_value);
+			}
+			else if (partial_value == 0) fold_identity(fs, op_pos);
+			else fold_range(fs, right, fs->pos, partial_value);
+		}
+		else if (is_const) {
+			fold_range(fs, start, op_pos, *value);
+			is_const = 0;
+		}
+	}
+	return is_const;
+}
+
+/* Multiplying or dividing factors. */
+static int fold_exp3(struct fold_state *fs, int *value)
+{
+	int start, op_pos, right, is_const, right_const, partial_value;
+	char op;
+
+	start = fs->pos;
+	is_const = fold_exp4(fs, value);
+	while (fold_is(fs->pos, '*') || fold_is(fs->pos, '/') || fold_is(fs->pos, '%')) {
+		op_pos = fs->pos;
+		op = lc->pg->t_pool[lc->pg->tok_buf[op_pos].text];
+		fold_advance(fs);
+		right = fs->pos;
+		right_const = fold_exp4(fs, &partial_value);
+		if (is_const && right_const && op != '*' &&
+			(partial_value == 0 || (partial_value == -1 && *value == INT_MIN))) {
+			fold_range(fs, start, op_pos, *value); /* the engines report it when run */
+			is_const = 0;
+		}
+		else if (is_const && right_const) {
+			if (op == '*') *value = (int)((unsigned)*value * (unsigned)partial_value);
+			else if (op == '/') *value = *value / partial_value;
+			else *value = *value - (*value / partial_value) * partial_value;
+			continue;
+		}
+		if (right_const) {
+			if (partial_value == 1 && op != '%') fold_identity(fs, op_pos);
+			else fold_range(fs, right, fs->pos, partial_value);
+		}
+		else if (is_const) {
+			fold_range(fs, start, op_pos, *value);
+			is_const = 0;
+		}
+	}
+	return is_const;
+}
+
+/* A unary + or -. */
+static int fold_exp4(struct fold_state *fs, int *value)
+{
+	struct lc_program *pg;
+	int op_pos, open, inner;
+	char op;
+
+	pg = lc->pg;
+	op = '\0';
+	op_pos = fs->pos;
+	if (fold_is(fs->pos, '+') || fold_is(fs->pos, '-')) {
+		op = pg->t_pool[pg->tok_buf[fs->pos].text];
+		fold_advance(fs);
+	}
+	open = fs->pos;
+	if (fold_exp5(fs, value)) {
+		if (op == '-') *value = (int)(0u - (unsigned)*value);
+		return 1;
+	}
+
+	/* -(-x) is x; the first - becomes a + that skips to x,
+	   and x skips the closing parenthesis */
+	if (op == '-' && pg->tok_buf[op_pos].skip == 0 && fold_is(open, '(') &&
+		pg->tok_buf[open].skip == 0 && fold_is(open + 1, '-') && pg->tok_buf[open + 1].skip == 0) {
+		inner = open + 2;
+		if (pg->tok_buf[inner].token_type == IDENTIFIER && is_var(&pg->tok_buf[inner]) &&
+			pg->tok_buf[inner].skip == 0 && pg->tok_buf[open].value == inner + 1) {
+			pg->tok_buf[op_pos].text = add_text("+", 1);
+			pg->tok_buf[op_pos].skip = inner - op_pos - 1;
+			pg->tok_buf[inner].skip = fs->pos - inner - 1;
+			fs->last = inner;
+			lc->folds++;
+		}
+	}
+	return 0;
+}
+
+/* A parenthesized expression. */
+static int fold_exp5(struct fold_state *fs, int *value)
+{
+	int is_const;
+
+	if (!fold_is(fs->pos, '(')) return fold_atom(fs, value);
+	fold_advance(fs);
+	is_const = fold_exp0(fs, value);
+	if (!fold_is(fs->pos, ')')) return 0;
+	fold_advance(fs);
+	return is_const;
+}
+
+/* A number, variable or function call. Only a number is constant. */
+static int fold_atom(struct fold_state *fs, int *value)
+{
+	struct lc_program *pg;
+	struct token_rec *t;
+
+	pg = lc->pg;
+	t = &pg->tok_buf[fs->pos];
+	switch (t->token_type) {
+	case NUMBER:
+		*value = t->value;
+		fold_advance(fs);
+		return 1;
+	case IDENTIFIER:
+		fold_advance(fs);
+		if ((t->bind == BIND_FUNC || t->bind == BIND_BUILTIN) && fold_is(fs->pos, '(')) {
+			fs->pos = pg->tok_buf[fs->pos].value; /* the closing parenthesis */
+			fold_advance(fs);
+		}
+		return 0;
+	default:
+		return 0; /* an empty expression, or not an expression */
+	}
+}
@@ -0,0 +1,69 @@
+/* Test the embedding API: a program that stops with an error makes
+   lc_run() return 1, and the interpreter can run programs again.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "lcapi.h"
+
+int failed = 0;
+
+/* Compile and run source on engine, and check its exit status and
+   that its output contains expect.
+*/
+void check(const char *name, const char *source, int engine, int status,
+	const char *expect)
+{
+	struct lc_io io;
+	struct lc_program *pg;
+	char out[256];
+	size_t n;
+	int i;
+
+	lc_defaults(&io, NULL);
+	if ((io.out = tmpfile()) == NULL) {
+		printf("cannot open a temporary file\n");
+		failed = 1;
+		return;
+	}
+	io.in = NULL;
+	if ((pg = lc_compile(source, engine, &io, NULL)) == NULL) {
+		printf("FAIL: %s: does not compile\n", name);
+		failed = 1;
+	}
+	else {
+		for (i = 0; i < 2; i++) /* a program can be run again */
+			if (lc_run(pg, &io, NULL) != status) {
+				printf("FAIL: %s: exit status should be %d\n", name, status);
+				failed = 1;
+			}
+		lc_free(pg);
+		rewind(io.out);
+		n = fread(out, 1, sizeof(out) - 1, io.out);
+		out[n] = '\0';
+		if (strstr(out, expect) == NULL) {
+			printf("FAIL: %s: output should contain \"%s\"\n", name, expect);
+			failed = 1;
+		}
+	}
+	fclose(io.out);
+}
+
+int main(void)
+{
+	const char *intmin =
+		"int main() { int x, y; x = -2147483647 - 1; y = -1; print(x / y); return 0; }";
+	const char *modmin =
+		"int main() { int x, y; x = -2147483647 - 1; y = -1; print(x % y); return 0; }";
+	const char *quotient =
+		"int main() { int x, y; x = -2147483647 - 1; y = 1; print(x / y); return 0; }";
+	int engine;
+
+	for (engine = TEXT_ENGINE; engine <= VM_ENGINE; engine++) {
+		check("INT_MIN / -1", intmin, engine, 1, "integer overflow");
+		check("INT_MIN % -1", modmin, engine, 1, "integer overflow");
+		check("INT_MIN / 1", quotient, engine, 0, "-2147483648");
+	}
+	if (!failed) printf("all API tests passed\n");
+	return failed;
+}
@@ -0,0 +1,15 @@
+/* Names are not case sensitive, as in the original Little C:
+   Total, TOTAL and total are one variable, and so are the
+   keywords and library functions however they are spelled. */
+int Total;
+int count;
+
+int main()
+{
+	int Count;
+	COUNT = 3;
+	total = 5;
+	WHILE (Count > 0) { Total = TOTAL + 1; count = count - 1; }
+	PRINT(TOTAL + COUNT);
+	Return 0;
+}
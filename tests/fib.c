@@ -0,0 +1,13 @@
+/* Print the first Fibonacci numbers. */
+int fib(int n)
+{
+	if (n < 2) { return n; }
+	return fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+	int i;
+	for (i = 0; i < 10; i = i + 1) { print(fib(i)); }
+	return 0;
+}
@@ -0,0 +1,15 @@
+/* The quotient of INT_MIN and -1 does not fit in an int. The
+   division is run often enough first to be compiled by --jit. */
+int quotient(int x, int y)
+{
+	return x / y;
+}
+
+int main()
+{
+	int i, x;
+	for (i = 0; i < 2000; i = i + 1) { x = quotient(i, -1); }
+	x = -2147483647 - 1;
+	print(quotient(x, -1));
+	return 0;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Run the tests with the interpreter named by the first argument.
+# Each test program t.c is expected to print t.exp; intmin.c fails.
+
+lc=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cd "$(dirname "$0")" || exit 1
+tmp=${TMPDIR:-/tmp}/lctest.$$
+mkdir "$tmp" || exit 1
+failed=0
+
+fail()
+{
+	echo "FAIL: $*"
+	failed=1
+}
+
+for engine in --engine=text --engine=vm --jit; do
+	# one job fails with an integer overflow, the others still finish
+	for t in sum intmin fib case; do
+		echo "$t.c - $tmp/$t.out"
+	done > "$tmp/jobs"
+	"$lc" $engine --batch "$tmp/jobs" -j 4 2> "$tmp/errors"
+	[ $? -eq 1 ] || fail "$engine: batch should exit with status 1"
+	grep -q "^intmin.c: exit status 1" "$tmp/errors" || fail "$engine: intmin.c not reported"
+	for t in sum intmin fib case; do
+		cmp -s $t.exp "$tmp/$t.out" || fail "$engine: batch $t.c"
+	done
+	rm -f "$tmp"/*
+done
+
+rm -rf "$tmp"
+[ $failed -eq 0 ] && echo "all tests passed"
+exit $failed
@@ -0,0 +1,9 @@
+/* Print the sum of 1 to 100. */
+int main()
+{
+	int i, s;
+	s = 0;
+	for (i = 1; i <= 100; i = i + 1) { s = s + i; }
+	print(s);
+	return 0;
+}